@@ -45,6 +45,7 @@ PyAPI_FUNC(PyObject *) PyClass_New(PyObject *, PyObject *, PyObject *);
 PyAPI_FUNC(PyObject *) PyInstance_New(PyObject *, PyObject *,
                                             PyObject *);
 PyAPI_FUNC(PyObject *) PyInstance_NewRaw(PyObject *, PyObject *);
+PyAPI_FUNC(PyObject *) _PyInstance_GetMethod(PyObject *, PyObject *);
 PyAPI_FUNC(PyObject *) PyMethod_New(PyObject *, PyObject *, PyObject *);
 
 PyAPI_FUNC(PyObject *) PyMethod_Function(PyObject *);
@@ -68,6 +68,9 @@ typedef struct {
 } PyWrapperDescrObject;
 
 PyAPI_DATA(PyTypeObject) PyWrapperDescr_Type;
+PyAPI_DATA(PyTypeObject) PyMethodDescr_Type;
+
+#define PyMethodDescr_Check(d) ((d)->ob_type == &PyMethodDescr_Type)
 
 PyAPI_FUNC(PyObject *) PyDescr_NewMethod(PyTypeObject *, PyMethodDef *);
 PyAPI_FUNC(PyObject *) PyDescr_NewClassMethod(PyTypeObject *, PyMethodDef *);
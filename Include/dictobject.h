@@ -85,6 +85,13 @@ struct _dictobject {
 	 */
 	PyDictEntry *ma_table;
 	PyDictEntry *(*ma_lookup)(PyDictObject *mp, PyObject *key, long hash);
+
+	/* Changes whenever a key is added, removed or bound to another
+	 * value.  No two dicts share a version, so that caches can check
+	 * the pair (dict, version) to know that the items they copied out
+	 * of the dict are still current.
+	 */
+	unsigned PY_LONG_LONG ma_version;
 	PyDictEntry ma_smalltable[PyDict_MINSIZE];
 };
 
@@ -47,6 +47,12 @@ PyAPI_FUNC(void) PyFloat_AsReprString(char*, PyFloatObject *v);
    preserve precision across conversions. */
 PyAPI_FUNC(void) PyFloat_AsString(char*, PyFloatObject *v);
 
+/* Like PyInt_CompactFreeList() and PyInt_GetFreeListStats(), for the
+   float free list */
+PyAPI_FUNC(int) PyFloat_CompactFreeList(void);
+PyAPI_FUNC(void) PyFloat_GetFreeListStats(Py_ssize_t *blocks, Py_ssize_t *bytes,
+					  Py_ssize_t *used, Py_ssize_t *free);
+
 /* _PyFloat_{Pack,Unpack}{4,8}
  *
  * The struct and pickle (at least) modules need an efficient platform-
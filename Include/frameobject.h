@@ -42,6 +42,7 @@ typedef struct _frame {
        f_trace is set) -- at other times use PyCode_Addr2Line instead. */
     int f_lineno;		/* Current line number */
     int f_iblock;		/* index in f_blockstack */
+    int f_onstack;		/* carved from f_tstate's frame stack */
     PyTryBlock f_blockstack[CO_MAXBLOCKS]; /* for try and loop blocks */
     PyObject *f_localsplus[1];	/* locals+stack, dynamically sized */
 } PyFrameObject;
@@ -75,6 +76,10 @@ PyAPI_FUNC(PyObject **) PyFrame_ExtendStack(PyFrameObject *, int, int);
 PyAPI_FUNC(void) PyFrame_LocalsToFast(PyFrameObject *, int);
 PyAPI_FUNC(void) PyFrame_FastToLocals(PyFrameObject *);
 
+/* Release the frame stack of a thread state that is going away */
+
+PyAPI_FUNC(void) _PyFrame_ClearStack(PyThreadState *);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,15 @@ PyAPI_FUNC(unsigned PY_LONG_LONG) PyInt_AsUnsignedLongLongMask(PyObject *);
 
 PyAPI_FUNC(long) PyInt_GetMax(void);
 
+/* Free the blocks of the int free list that hold no live ints any more;
+   returns the number of blocks freed.  Full collections of the garbage
+   collector call this. */
+PyAPI_FUNC(int) PyInt_CompactFreeList(void);
+/* Occupancy of the int free list: blocks allocated, their size in bytes,
+   and the ints in them that are in use and free */
+PyAPI_FUNC(void) PyInt_GetFreeListStats(Py_ssize_t *nblocks, Py_ssize_t *nbytes,
+					Py_ssize_t *nused, Py_ssize_t *nfree);
+
 /* Macro, trading safety for speed */
 #define PyInt_AS_LONG(op) (((PyIntObject *)(op))->ob_ival)
 
@@ -80,9 +80,12 @@ whose size is determined when the object is allocated.
 	Py_ssize_t ob_refcnt;		\
 	struct _typeobject *ob_type;
 
+/* Statically allocated objects (type objects, None, True, False...) are
+ * never freed, and are immortal (see Py_INCREF below).
+ */
 #define PyObject_HEAD_INIT(type)	\
 	_PyObject_EXTRA_INIT		\
-	1, type,
+	_Py_IMMORTAL_REFCNT, type,
 
 /* PyObject_VAR_HEAD defines the initial segment of all variable-size
  * container objects.  These end with a declaration of an array with 1
@@ -334,6 +337,9 @@ typedef struct _typeobject {
 	PyObject *tp_weaklist;
 	destructor tp_del;
 
+	/* Type attribute cache version tag. Added in version 2.6 */
+	unsigned int tp_version_tag;
+
 #ifdef COUNT_ALLOCS
 	/* these must be last and never explicitly initialized */
 	Py_ssize_t tp_allocs;
@@ -384,6 +390,8 @@ PyAPI_FUNC(PyObject *) PyType_GenericAlloc(PyTypeObject *, Py_ssize_t);
 PyAPI_FUNC(PyObject *) PyType_GenericNew(PyTypeObject *,
 					       PyObject *, PyObject *);
 PyAPI_FUNC(PyObject *) _PyType_Lookup(PyTypeObject *, PyObject *);
+PyAPI_FUNC(void) PyType_Modified(PyTypeObject *);
+PyAPI_FUNC(int) _PyType_AssignVersionTag(PyTypeObject *);
 
 /* Generic operations on objects */
 PyAPI_FUNC(int) PyObject_Print(PyObject *, FILE *, int);
@@ -406,6 +414,7 @@ PyAPI_FUNC(int) PyObject_HasAttr(PyObject *, PyObject *);
 PyAPI_FUNC(PyObject **) _PyObject_GetDictPtr(PyObject *);
 PyAPI_FUNC(PyObject *) PyObject_SelfIter(PyObject *);
 PyAPI_FUNC(PyObject *) PyObject_GenericGetAttr(PyObject *, PyObject *);
+PyAPI_FUNC(int) _PyObject_GetMethod(PyObject *, PyObject *, PyObject **);
 PyAPI_FUNC(int) PyObject_GenericSetAttr(PyObject *,
 					      PyObject *, PyObject *);
 PyAPI_FUNC(long) PyObject_Hash(PyObject *);
@@ -517,6 +526,10 @@ given type object has a specified feature.
 /* Objects support nb_index in PyNumberMethods */
 #define Py_TPFLAGS_HAVE_INDEX (1L<<17)
 
+/* Objects support type attribute cache */
+#define Py_TPFLAGS_HAVE_VERSION_TAG   (1L<<18)
+#define Py_TPFLAGS_VALID_VERSION_TAG  (1L<<19)
+
 #define Py_TPFLAGS_DEFAULT  ( \
                              Py_TPFLAGS_HAVE_GETCHARBUFFER | \
                              Py_TPFLAGS_HAVE_SEQUENCE_IN | \
@@ -527,6 +540,7 @@ given type object has a specified feature.
                              Py_TPFLAGS_HAVE_CLASS | \
                              Py_TPFLAGS_HAVE_STACKLESS_EXTENSION | \
                              Py_TPFLAGS_HAVE_INDEX | \
+                             Py_TPFLAGS_HAVE_VERSION_TAG | \
                             0)
 
 #define PyType_HasFeature(t,f)  (((t)->tp_flags & (f)) != 0)
@@ -559,8 +573,8 @@ complications in the deallocation function.  (This is actually a
 decision that's up to the implementer of each new type so if you want,
 you can count such references to the type object.)
 
-*** WARNING*** The Py_DECREF macro must have a side-effect-free argument
-since it may evaluate its argument multiple times.  (The alternative
+*** WARNING*** The Py_INCREF and Py_DECREF macros must have a
+side-effect-free argument since they may evaluate it multiple times.  (The alternative
 would be to mace it a proper function or assign it to a global temporary
 variable first, both of which are slower; and in a multi-threaded
 environment the global variable trick is not safe.)
@@ -636,12 +650,27 @@ PyAPI_FUNC(void) _Py_AddToAllObjects(PyObject *, int force);
 	(*(op)->ob_type->tp_dealloc)((PyObject *)(op)))
 #endif /* !Py_TRACE_REFS */
 
-#define Py_INCREF(op) (				\
-	_Py_INC_REFTOTAL  _Py_REF_DEBUG_COMMA	\
-	(op)->ob_refcnt++)
+/* Immortal objects have a reference count of about _Py_IMMORTAL_REFCNT,
+ * which Py_INCREF and Py_DECREF leave alone: they are never freed, and
+ * referring to them writes nothing to the memory that holds them, so
+ * that its pages stay shared with the process a worker was forked from.
+ * Half the range lies between them and mortal objects, so that
+ * extensions built without this check can't make them mortal either.
+ */
+#define _Py_IMMORTAL_REFCNT	(PY_SSIZE_T_MAX / 2)
+#define _Py_IsImmortal(op)	((op)->ob_refcnt > _Py_IMMORTAL_REFCNT / 2)
+/* Make op immortal; for objects that live until the process exits. */
+PyAPI_FUNC(void) _Py_SetImmortal(PyObject *);
+
+#define Py_INCREF(op) (					\
+	_Py_IsImmortal(op) ? (void)0 :			\
+	(void)(_Py_INC_REFTOTAL  _Py_REF_DEBUG_COMMA	\
+	       (op)->ob_refcnt++))
 
 #define Py_DECREF(op)					\
-	if (_Py_DEC_REFTOTAL  _Py_REF_DEBUG_COMMA	\
+	if (_Py_IsImmortal(op))				\
+		;					\
+	else if (_Py_DEC_REFTOTAL  _Py_REF_DEBUG_COMMA	\
 	    --(op)->ob_refcnt != 0)			\
 		_Py_CHECK_REFCNT(op)			\
 	else						\
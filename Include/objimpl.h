@@ -98,6 +98,17 @@ PyAPI_FUNC(void *) PyObject_Malloc(size_t);
 PyAPI_FUNC(void *) PyObject_Realloc(void *, size_t);
 PyAPI_FUNC(void) PyObject_Free(void *);
 
+/* Give the memory of the object allocator's free pools back to the
+   system, where it can (full garbage collections call this); returns
+   the number of pools released. */
+PyAPI_FUNC(Py_ssize_t) _PyObject_ReleaseFreePools(void);
+
+/* Counters of the object allocator, kept in release builds, and the
+   sampling of the Python stacks that allocate (see the gc module). */
+PyAPI_FUNC(PyObject *) _PyObject_GetMallocStats(void);
+PyAPI_FUNC(int) _PyObject_SetMallocSampling(size_t interval);
+PyAPI_FUNC(PyObject *) _PyObject_TakeMallocSamples(void);
+
 
 /* Macros */
 #ifdef WITH_PYMALLOC
@@ -95,6 +95,10 @@ typedef struct _ts {
     PyObject *async_exc; /* Asynchronous exception to raise */
     long thread_id; /* Thread id where this tstate was created */
 
+    /* Chunk of memory that frames of this thread are currently carved
+       from (see Objects/frameobject.c). */
+    struct _framechunk *frame_chunk;
+
     /* XXX signal handlers should also be here */
 
 } PyThreadState;
@@ -124,6 +124,9 @@ PyAPI_FUNC(int) _PyFrame_Init(void);
 PyAPI_FUNC(int) _PyInt_Init(void);
 PyAPI_FUNC(void) _PyFloat_Init(void);
 
+/* The entry of __builtin__'s method table for a builtin function */
+PyAPI_FUNC(PyMethodDef *) _PyBuiltin_FindMethod(const char *);
+
 /* Various internal finalizers */
 PyAPI_FUNC(void) _PyExc_Fini(void);
 PyAPI_FUNC(void) _PyImport_Fini(void);
@@ -6,15 +6,24 @@ extern "C" {
 #endif
 
 struct _frame;
+struct _tbentry;
 
 /* Traceback interface */
 
+/* The frames an exception passes through are recorded cheaply and only
+   built into a chain of traceback objects when it is looked at: while
+   tb_npending is nonzero, tb_pending holds the frames between tb_frame
+   and tb_next, and tb_lineno is -1 until it is asked for.  Read these
+   members through getattr or the traceback module, not directly. */
 typedef struct _traceback {
 	PyObject_HEAD
 	struct _traceback *tb_next;
 	struct _frame *tb_frame;
 	int tb_lasti;
 	int tb_lineno;
+	int tb_npending;
+	int tb_allocated;
+	struct _tbentry *tb_pending;
 } PyTracebackObject;
 
 PyAPI_FUNC(int) PyTraceBack_Here(struct _frame *);
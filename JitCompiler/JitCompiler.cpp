@@ -6,6 +6,7 @@
 #include "Python.h"
 #include "opcode.h"
 #include "pythonrun.h"
+#include "marshal.h"
 #include "frameobject.h"
 #include "pythread.h"
 
@@ -14,11 +15,520 @@
 #include <stdint.h>
 #include <cstdlib>
 #include <stdexcept>
+#include <fcntl.h>
 
 static intptr_t py_id(PyObject* o) {
     return (intptr_t)o;
 }
 
+// One decoded bytecode instruction. An EXTENDED_ARG prefix is folded
+// into the instruction it extends: start is the offset of the prefix
+// (what jumps refer to) while line is the offset of the opcode itself
+// (what f_lasti is set to).
+struct Instr {
+    int start;
+    int line;
+    unsigned int opcode;
+    unsigned int oparg;
+    int next;       // offset of the following instruction
+};
+
+static Instr decode_instr(const uint8_t* bytecode, Py_ssize_t codelen, int start) {
+    Instr in;
+    in.start = in.line = start;
+    in.opcode = bytecode[start];
+    in.oparg = 0;
+    if (in.opcode == EXTENDED_ARG && start + 3 < codelen) {
+        in.oparg = ((bytecode[start + 2] << 8) + bytecode[start + 1]) << 16;
+        in.line = start + 3;
+        in.opcode = bytecode[in.line];
+    }
+    in.next = in.line + 1;
+    if (HAS_ARG(in.opcode)) {
+        if (in.line + 2 >= codelen) {
+            in.opcode = STOP_CODE; // truncated, end the code here
+            return in;
+        }
+        in.oparg += (bytecode[in.line + 2] << 8) + bytecode[in.line + 1];
+        in.next += 2;
+    }
+    return in;
+}
+
+// The body of an except clause that catches a class named by a global
+// and drops the exception:
+//
+//     DUP_TOP; LOAD_GLOBAL name; COMPARE_OP exception match;
+//     JUMP_IF_FALSE next_clause; POP_TOP; POP_TOP; POP_TOP; POP_TOP
+//
+// followed by code that only moves constants and locals around until
+// the frame returns, so that nothing can look at sys.exc_info() or
+// re-raise with a bare raise afterwards and find the exception missing.
+// Returns the offset of the body, or -1.
+static int discarding_handler(const uint8_t* bytecode, Py_ssize_t codelen,
+                              int handler, int* name) {
+    static const unsigned int head[] = {
+        DUP_TOP, LOAD_GLOBAL, COMPARE_OP, JUMP_IF_FALSE,
+        POP_TOP, POP_TOP, POP_TOP, POP_TOP
+    };
+    int start = handler;
+    for (size_t k = 0; k < sizeof(head) / sizeof(head[0]); ++k) {
+        if (start >= codelen)
+            return -1;
+        Instr in = decode_instr(bytecode, codelen, start);
+        if (in.opcode != head[k])
+            return -1;
+        if (in.opcode == COMPARE_OP && in.oparg != PyCmp_EXC_MATCH)
+            return -1;
+        if (in.opcode == LOAD_GLOBAL)
+            *name = in.oparg;
+        start = in.next;
+    }
+    int body = start;
+    std::vector<bool> seen(codelen);
+    std::vector<int> todo(1, body);
+    while (!todo.empty()) {
+        start = todo.back();
+        todo.pop_back();
+        if (start < 0 || start >= codelen)
+            return -1;
+        if (seen[start])
+            continue;
+        seen[start] = true;
+        Instr in = decode_instr(bytecode, codelen, start);
+        switch (in.opcode) {
+        case LOAD_CONST:
+        case LOAD_FAST:
+        case STORE_FAST:
+        case POP_TOP:
+        case DUP_TOP:
+        case ROT_TWO:
+        case ROT_THREE:
+        case POP_BLOCK:
+            todo.push_back(in.next);
+            break;
+        case JUMP_FORWARD:
+            todo.push_back(in.next + in.oparg);
+            break;
+        case JUMP_ABSOLUTE:
+            todo.push_back(in.oparg);
+            break;
+        case RETURN_VALUE:
+            break;
+        default:
+            return -1;
+        }
+    }
+    return body;
+}
+
+// Block nesting of a code object, resolved at compile time. blocks and
+// block_at are referenced by the generated code, so they must live as
+// long as the compiled function.
+struct StaticBlocks {
+    StaticBlocks() : resolved(false) {}
+
+    bool resolved;                        // false: use f_blockstack
+    std::vector<jit_static_block> blocks;
+    std::vector<int> block_at;            // innermost block at each offset
+
+    // Innermost SETUP_LOOP enclosing block b, or -1.
+    int enclosing_loop(int b) const {
+        for (; b >= 0; b = blocks[b].b_parent)
+            if (blocks[b].b_type == SETUP_LOOP)
+                return b;
+        return -1;
+    }
+
+    // Whether a SETUP_FINALLY lies between block b and its ancestor up_to.
+    bool finally_between(int b, int up_to) const {
+        for (; b != up_to; b = blocks[b].b_parent)
+            if (blocks[b].b_type == SETUP_FINALLY)
+                return true;
+        return false;
+    }
+
+    // Every path reaching an instruction must agree on the blocks that
+    // enclose it. This holds for code produced by the compiler; if it
+    // doesn't we fall back to f_blockstack.
+    bool analyze(const uint8_t* bytecode, Py_ssize_t codelen) {
+        const int unvisited = -2;
+        std::map<std::pair<int, int>, int> interned; // (line, parent) -> block
+        std::vector<int> todo;
+
+        blocks.clear();
+        block_at.assign(codelen, unvisited);
+        resolved = false;
+
+#       define SUCCESSOR(LINE, BLOCK)                                   \
+        {                                                               \
+            int succ_ = (LINE), block_ = (BLOCK);                       \
+            if (succ_ < 0 || succ_ >= codelen) return false;            \
+            if (block_at[succ_] == unvisited) {                         \
+                block_at[succ_] = block_;                               \
+                todo.push_back(succ_);                                  \
+            }                                                           \
+            else if (block_at[succ_] != block_) return false;           \
+        }                                                               \
+        /**/
+
+        SUCCESSOR(0, -1);
+        while (!todo.empty()) {
+            Instr in = decode_instr(bytecode, codelen, todo.back());
+            todo.pop_back();
+            int line = in.start;
+            int cur = block_at[line];
+            unsigned int opcode = in.opcode;
+            unsigned int oparg = in.oparg;
+            int next_line = in.next;
+            block_at[in.line] = cur; // f_lasti when unwinding from here
+
+            switch (opcode) {
+            case SETUP_LOOP:
+            case SETUP_EXCEPT:
+            case SETUP_FINALLY: {
+                std::pair<int, int> key(line, cur);
+                int b;
+                if (interned.count(key)) {
+                    b = interned[key];
+                }
+                else {
+                    jit_static_block sb;
+                    sb.b_type = opcode;
+                    sb.b_handler = next_line + oparg;
+                    sb.b_depth = cur < 0 ? 0 : blocks[cur].b_depth + 1;
+                    sb.b_parent = cur;
+                    sb.b_discard = -1;
+                    sb.b_discard_name = -1;
+                    // a return runs the finally clauses of the blocks
+                    // around, which may look at the exception
+                    if (opcode == SETUP_EXCEPT && !finally_between(cur, -1))
+                        sb.b_discard = discarding_handler(bytecode, codelen, sb.b_handler,
+                                                          &sb.b_discard_name);
+                    if (sb.b_depth >= CO_MAXBLOCKS)
+                        return false;
+                    b = blocks.size();
+                    blocks.push_back(sb);
+                    interned[key] = b;
+                }
+                SUCCESSOR(next_line, b);
+                SUCCESSOR(next_line + oparg, cur); // handler
+                break;
+            }
+            case POP_BLOCK:
+                if (cur < 0)
+                    return false;
+                SUCCESSOR(next_line, blocks[cur].b_parent);
+                break;
+            case BREAK_LOOP: {
+                int loop = enclosing_loop(cur);
+                if (loop < 0)
+                    return false;
+                SUCCESSOR(blocks[loop].b_handler, blocks[loop].b_parent);
+                break;
+            }
+            case CONTINUE_LOOP: {
+                int loop = enclosing_loop(cur);
+                if (loop < 0)
+                    return false;
+                SUCCESSOR(oparg, loop);
+                break;
+            }
+            case JUMP_FORWARD:
+                SUCCESSOR(next_line + oparg, cur);
+                break;
+            case JUMP_ABSOLUTE:
+                SUCCESSOR(oparg, cur);
+                break;
+            case JUMP_IF_TRUE:
+            case JUMP_IF_FALSE:
+            case FOR_ITER:
+                SUCCESSOR(next_line, cur);
+                SUCCESSOR(next_line + oparg, cur);
+                break;
+            case RETURN_VALUE:
+            case RAISE_VARARGS:
+            case STOP_CODE:
+                break;
+            default:
+                if (next_line < codelen && bytecode[next_line])
+                    SUCCESSOR(next_line, cur);
+                break;
+            }
+        }
+#       undef SUCCESSOR
+
+        // unreachable code: treat it as not being in any block
+        for (size_t i = 0; i < block_at.size(); ++i)
+            if (block_at[i] == unvisited)
+                block_at[i] = -1;
+        resolved = true;
+        return true;
+    }
+};
+
+// How often a JUMP_IF_TRUE/JUMP_IF_FALSE/FOR_ITER jumped to its target
+// and how often it fell through, counted by the profiling tier.
+struct BranchProfile {
+    uint32_t taken;
+    uint32_t not_taken;
+};
+
+// Everything the generated code of one code object points to: it is
+// owned by the PyJittedFunc and must not move once compiled. All the
+// versions compiled for the code object share it.
+struct CodeData {
+    CodeData() : compiled(false), backedges(0) {}
+
+    bool compiled;                        // caches and blocks are set up
+    StaticBlocks blocks;
+    std::vector<jit_call_cache> call_caches;
+    std::vector<jit_subscr_cache> subscr_caches;
+    std::vector<jit_binop_cache> binop_caches;
+    std::vector<jit_global_cache> global_caches;
+    std::vector<jit_attr_cache> attr_caches;
+    std::vector<BranchProfile> branch_profile;  // by offset, if profiled
+    uint32_t backedges;                   // loop iterations while profiled
+
+    ~CodeData() {
+        for (size_t i = 0; i < call_caches.size(); ++i) {
+            for (int k = 0; k < call_caches[i].kw_count; ++k)
+                Py_XDECREF(call_caches[i].kw_names[k]);
+        }
+    }
+};
+
+// Number of instructions with the given opcode in the bytecode.
+static size_t count_opcode(const uint8_t* bytecode, Py_ssize_t codelen, unsigned int opcode) {
+    size_t n = 0;
+    for (int start = 0; start < codelen && bytecode[start]; ) {
+        Instr in = decode_instr(bytecode, codelen, start);
+        if (in.opcode == opcode)
+            ++n;
+        start = in.next;
+    }
+    return n;
+}
+
+// Arithmetic operators that get a jit_binop_cache.
+static bool is_cached_binop(unsigned int opcode) {
+    switch (opcode) {
+    case BINARY_ADD:
+    case BINARY_SUBTRACT:
+    case BINARY_MULTIPLY:
+    case BINARY_DIVIDE:
+    case BINARY_TRUE_DIVIDE:
+    case BINARY_FLOOR_DIVIDE:
+    case BINARY_MODULO:
+        return true;
+    }
+    return false;
+}
+
+static size_t count_binops(const uint8_t* bytecode, Py_ssize_t codelen) {
+    size_t n = 0;
+    for (int start = 0; start < codelen && bytecode[start]; ) {
+        Instr in = decode_instr(bytecode, codelen, start);
+        if (is_cached_binop(in.opcode))
+            ++n;
+        start = in.next;
+    }
+    return n;
+}
+
+// Offsets that some instruction can jump to, including the handlers
+// of SETUP_* blocks.
+static std::vector<bool> jump_targets(const uint8_t* bytecode, Py_ssize_t codelen) {
+    std::vector<bool> targets(codelen + 1);
+    for (int start = 0; start < codelen && bytecode[start]; ) {
+        Instr in = decode_instr(bytecode, codelen, start);
+        switch (in.opcode) {
+        case JUMP_FORWARD:
+        case JUMP_IF_FALSE:
+        case JUMP_IF_TRUE:
+        case FOR_ITER:
+        case SETUP_LOOP:
+        case SETUP_EXCEPT:
+        case SETUP_FINALLY:
+            if (in.next + in.oparg <= codelen)
+                targets[in.next + in.oparg] = true;
+            break;
+        case JUMP_ABSOLUTE:
+        case CONTINUE_LOOP:
+            if (in.oparg <= (unsigned int)codelen)
+                targets[in.oparg] = true;
+            break;
+        }
+        start = in.next;
+    }
+    return targets;
+}
+
+// GET_ITER instructions of list comprehensions that append exactly one
+// item per item of their iterable: BUILD_LIST 0, DUP_TOP, STORE_* _[n],
+// <iterable>, GET_ITER, FOR_ITER with a loop body free of conditional
+// jumps and nested loops, with a single LIST_APPEND. Their result list
+// can be sized to the iterable up front.
+static std::vector<bool> presized_comprehensions(const uint8_t* bytecode, Py_ssize_t codelen) {
+    std::vector<bool> presized(codelen + 1);
+    for (int start = 0; start < codelen && bytecode[start]; ) {
+        Instr build = decode_instr(bytecode, codelen, start);
+        start = build.next;
+        if (build.opcode != BUILD_LIST || build.oparg != 0 || build.next + 1 >= codelen ||
+            bytecode[build.next] != DUP_TOP)
+            continue;
+        Instr store = decode_instr(bytecode, codelen, build.next + 1);
+        if (store.opcode != STORE_FAST && store.opcode != STORE_NAME)
+            continue;
+        // the iterable: give up on anything that nests another
+        // comprehension or a generator expression
+        int pos = store.next;
+        Instr in = store;
+        while (pos < codelen && bytecode[pos]) {
+            in = decode_instr(bytecode, codelen, pos);
+            if (in.opcode == GET_ITER || in.opcode == BUILD_LIST ||
+                in.opcode == MAKE_FUNCTION || in.opcode == MAKE_CLOSURE)
+                break;
+            pos = in.next;
+        }
+        if (in.opcode != GET_ITER || in.next >= codelen)
+            continue;
+        Instr loop = decode_instr(bytecode, codelen, in.next);
+        if (loop.opcode != FOR_ITER)
+            continue;
+        int appends = 0;
+        bool simple = true;
+        for (pos = loop.next; simple && pos < (int)(loop.next + loop.oparg) && pos < codelen; ) {
+            Instr body = decode_instr(bytecode, codelen, pos);
+            switch (body.opcode) {
+            case LIST_APPEND:
+                ++appends;
+                break;
+            case JUMP_IF_FALSE:
+            case JUMP_IF_TRUE:
+            case FOR_ITER:
+            case SETUP_LOOP:
+            case SETUP_EXCEPT:
+            case SETUP_FINALLY:
+            case BREAK_LOOP:
+            case CONTINUE_LOOP:
+                simple = false;
+                break;
+            }
+            pos = body.next;
+        }
+        if (simple && appends == 1)
+            presized[in.start] = true;
+    }
+    return presized;
+}
+
+// Offsets at which compiled code stores f_lasti: the first instruction
+// of each line (from co_lnotab) and the jump targets, where control may
+// come back to a line from elsewhere.
+static std::vector<bool> lasti_stores(PyCodeObject* co, Py_ssize_t codelen,
+                                      const std::vector<bool>& targets) {
+    std::vector<bool> stores(targets);
+    const unsigned char* p = (const unsigned char*) PyString_AS_STRING(co->co_lnotab);
+    Py_ssize_t size = PyString_GET_SIZE(co->co_lnotab) / 2;
+    int addr = 0;
+    stores[0] = true;
+    for (Py_ssize_t i = 0; i < size; ++i, p += 2) {
+        addr += p[0];
+        if (p[1] != 0 && addr < codelen)
+            stores[addr] = true;
+    }
+    return stores;
+}
+
+// Targets of the JUMP_ABSOLUTEs that jump backwards: the loop headers
+// at which a frame can move on to code compiled while it runs.
+static std::vector<bool> loop_headers(const uint8_t* bytecode, Py_ssize_t codelen) {
+    std::vector<bool> headers(codelen + 1);
+    for (int start = 0; start < codelen && bytecode[start]; ) {
+        Instr in = decode_instr(bytecode, codelen, start);
+        if (in.opcode == JUMP_ABSOLUTE && (int)in.oparg <= in.start)
+            headers[in.oparg] = true;
+        start = in.next;
+    }
+    return headers;
+}
+
+// Instructions that run according to the branch profile: everything
+// reachable from the entry without following a branch edge that was
+// never taken while the other edge of the branch was. Exception
+// handlers are assumed to run.
+static std::vector<bool> hot_code(const uint8_t* bytecode, Py_ssize_t codelen,
+                                  const std::vector<BranchProfile>& profile) {
+    std::vector<bool> hot(codelen + 1);
+    std::vector<int> todo;
+
+#   define HOT_EDGE(LINE)                                               \
+    {                                                                   \
+        int succ_ = (LINE);                                             \
+        if (succ_ >= 0 && succ_ < codelen && !hot[succ_]) {             \
+            hot[succ_] = true;                                          \
+            todo.push_back(succ_);                                      \
+        }                                                               \
+    }                                                                   \
+    /**/
+
+    HOT_EDGE(0);
+    while (!todo.empty()) {
+        Instr in = decode_instr(bytecode, codelen, todo.back());
+        todo.pop_back();
+        const BranchProfile& p = profile[in.start];
+        bool seen = p.taken || p.not_taken;
+        switch (in.opcode) {
+        case JUMP_IF_TRUE:
+        case JUMP_IF_FALSE:
+        case FOR_ITER:
+            if (!seen || p.taken)
+                HOT_EDGE(in.next + in.oparg);
+            if (!seen || p.not_taken)
+                HOT_EDGE(in.next);
+            break;
+        case SETUP_LOOP:
+        case SETUP_EXCEPT:
+        case SETUP_FINALLY:
+            HOT_EDGE(in.next + in.oparg);
+            HOT_EDGE(in.next);
+            break;
+        case JUMP_FORWARD:
+            HOT_EDGE(in.next + in.oparg);
+            break;
+        case JUMP_ABSOLUTE:
+        case CONTINUE_LOOP:
+            HOT_EDGE(in.oparg);
+            break;
+        case RETURN_VALUE:
+        case RAISE_VARARGS:
+        case BREAK_LOOP:
+            break;
+        default:
+            HOT_EDGE(in.next);
+        }
+    }
+#   undef HOT_EDGE
+    return hot;
+}
+
+// Calls after which code compiled with branch counters is compiled
+// again, laid out by the profile.
+#define JIT_PROFILE_CALLS 1000
+
+// Loop iterations after which the same happens, within a call: the
+// frame then continues in the new code from the loop header.
+#define JIT_PROFILE_EDGES 1000
+
+// Calls after which code leaves the baseline tier (the interpreter
+// tier) and is compiled: interpreting code that runs a few times costs
+// less than compiling it.
+#define JIT_BASELINE_CALLS 10
+
+// Loop iterations after which the same happens, within a call.
+#define JIT_BASELINE_EDGES 100
+
 class JITRuntime {
 public:
     JITRuntime(int optimize = 1) {
@@ -52,6 +562,31 @@ public:
         is_top_true->setCallingConv(CallingConv::Fast);
         unwind_stack = the_module->getFunction("unwind_stack");
         unwind_stack->setCallingConv(CallingConv::Fast);
+        unwind_stack_traced = the_module->getFunction("unwind_stack_traced");
+        unwind_stack_traced->setCallingConv(CallingConv::Fast);
+        unwind_stack_static = the_module->getFunction("unwind_stack_static");
+        unwind_stack_static->setCallingConv(CallingConv::Fast);
+        setup_block_static = the_module->getFunction("opcode_SETUP_BLOCK_STATIC");
+        setup_block_static->setCallingConv(CallingConv::Fast);
+        pop_block_static = the_module->getFunction("opcode_POP_BLOCK_STATIC");
+        pop_block_static->setCallingConv(CallingConv::Fast);
+        reverse_stack = the_module->getFunction("opcode_REVERSE_STACK");
+        reverse_stack->setCallingConv(CallingConv::Fast);
+        get_iter_presized = the_module->getFunction("opcode_GET_ITER_PRESIZED");
+        set_lasti = the_module->getFunction("set_lasti");
+        get_iter_presized->setCallingConv(CallingConv::Fast);
+        call_function_cached = the_module->getFunction("opcode_CALL_FUNCTION_CACHED");
+        call_function_cached->setCallingConv(CallingConv::Fast);
+        binary_subscr_cached = the_module->getFunction("opcode_BINARY_SUBSCR_CACHED");
+        binary_subscr_cached->setCallingConv(CallingConv::Fast);
+        store_subscr_cached = the_module->getFunction("opcode_STORE_SUBSCR_CACHED");
+        store_subscr_cached->setCallingConv(CallingConv::Fast);
+        binary_op_cached = the_module->getFunction("opcode_BINARY_OP_CACHED");
+        binary_op_cached->setCallingConv(CallingConv::Fast);
+        load_global_cached = the_module->getFunction("opcode_LOAD_GLOBAL_CACHED");
+        load_global_cached->setCallingConv(CallingConv::Fast);
+        load_attr_cached = the_module->getFunction("opcode_LOAD_ATTR_CACHED");
+        load_attr_cached->setCallingConv(CallingConv::Fast);
 
         FPM = new FunctionPassManager(MP);
         FPM->add(new TargetData(*EE->getTargetData()));
@@ -126,6 +661,12 @@ public:
         PMverifier.add(llvm::createVerifierPass());
 
         register_opcodes();
+
+        interpreter_func = 0;
+        traced_interpreter_func = 0;
+        stats.compiled = 0;
+        stats.recompiled = 0;
+        stats.baseline = 0;
     }
   
     ~JITRuntime() {
@@ -133,7 +674,12 @@ public:
         delete FPM;
     }
   
-    llvm::Function* compile(PyCodeObject* co, int inlineopcodes = 1) {
+    // Compile co to a function with the signature of
+    // PyEval_EvalFrameEx. With profiling the branches of the code count
+    // where they go into data.branch_profile; without it a profile
+    // collected earlier decides the block layout.
+    llvm::Function* compile(PyCodeObject* co, CodeData& data, int inlineopcodes = 1,
+                            bool profiling = false) {
         using namespace llvm;
     
         std::string fname = make_function_name(co);
@@ -151,6 +697,41 @@ public:
 
         const uint8_t* bytecode = (const uint8_t*) PyString_AS_STRING(co->co_code);
         Py_ssize_t codelen = PyString_Size(co->co_code);
+        bool is_generator = (co->co_flags & CO_GENERATOR) != 0;
+        StaticBlocks& blocks = data.blocks;
+        if (!data.compiled) {
+            // code compiled earlier may still be running: only set up
+            // what it points to the first time
+            jit_call_cache empty_call_cache = { 0, JIT_INTRINSIC_NONE };
+            data.call_caches.assign(count_opcode(bytecode, codelen, CALL_FUNCTION), empty_call_cache);
+            jit_subscr_cache empty_subscr_cache = { JIT_SUBSCR_UNKNOWN, 0 };
+            data.subscr_caches.assign(count_opcode(bytecode, codelen, BINARY_SUBSCR) +
+                                      count_opcode(bytecode, codelen, STORE_SUBSCR),
+                                      empty_subscr_cache);
+            jit_binop_cache empty_binop_cache = { 0, 0, 0, 0 };
+            data.binop_caches.assign(count_binops(bytecode, codelen), empty_binop_cache);
+            jit_global_cache empty_global_cache = { 0, 0, 0, 0, 0 };
+            data.global_caches.assign(count_opcode(bytecode, codelen, LOAD_GLOBAL), empty_global_cache);
+            jit_attr_cache empty_attr_cache = { 0, 0 };
+            data.attr_caches.assign(count_opcode(bytecode, codelen, LOAD_ATTR), empty_attr_cache);
+            // Generator frames may be suspended inside blocks and inspected
+            // through f_iblock (PyGen_NeedsFinalizing), keep them on f_blockstack.
+            if (!is_generator)
+                blocks.analyze(bytecode, codelen);
+            data.compiled = true;
+        }
+        if (profiling && data.branch_profile.empty())
+            data.branch_profile.resize(codelen);
+        bool use_profile = !profiling && !data.branch_profile.empty();
+        size_t n_call_caches = 0;
+        size_t n_subscr_caches = 0;
+        size_t n_binop_caches = 0;
+        size_t n_global_caches = 0;
+        size_t n_attr_caches = 0;
+        std::vector<bool> targets = jump_targets(bytecode, codelen);
+        std::vector<bool> presized = presized_comprehensions(bytecode, codelen);
+        std::vector<bool> stores = lasti_stores(co, codelen, targets);
+        bool static_blocks = !is_generator && blocks.resolved;
         
         BasicBlock* entry = BasicBlock::Create("entry", func);
         BasicBlock* gen_throw_block = BasicBlock::Create("gen_throw", func);
@@ -178,10 +759,11 @@ public:
         SwitchInst* dispatch_switch = builder.CreateSwitch(dispatch_val, end_block);
 
         std::vector<BasicBlock*> opblocks(codelen);
-        for (const uint8_t* cur_instr = bytecode; *cur_instr; ++cur_instr) {
-            int line = cur_instr - bytecode;
-            unsigned int opcode = *cur_instr;
-            if (HAS_ARG(opcode)) cur_instr += 2;
+        std::vector<int> yield_lines;
+        for (int start = 0; start < codelen && bytecode[start];
+             start = decode_instr(bytecode, codelen, start).next) {
+            int line = start;
+            unsigned int opcode = bytecode[start];
             
             char opblockname[20];
             sprintf(opblockname, "__op_%d", line);
@@ -189,35 +771,61 @@ public:
             
             opblocks[line] = opblock; 
             dispatch_switch->addCase(constant(line), opblock);
+            if (opcode == YIELD_VALUE)
+                yield_lines.push_back(line);
         }
         
         BasicBlock* block_end_block = BasicBlock::Create("block_end", func);
 
-        // if throwflag goto block_end else dispatch to opblocks[f_lasti+1]
         builder.SetInsertPoint(entry);
-        CallInst* gli = builder.CreateCall(the_module->getFunction("get_lasti"),
-                                           func_f);
-        to_inline.push_back(gli);
-        Value* lastipp = builder.CreateAdd(gli, constant(1));
-        builder.CreateStore(lastipp, dispatch_var);
-        builder.CreateCondBr(is_zero(builder, func_throwflag), dispatch_block, gen_throw_block);
+        if (is_generator) {
+            // if throwflag goto block_end else resume right after the
+            // YIELD_VALUE that suspended us, without going through the
+            // per-offset dispatch switch
+            BasicBlock* resume_block = BasicBlock::Create("resume", func);
+            builder.CreateCondBr(is_zero(builder, func_throwflag), resume_block, gen_throw_block);
+
+            builder.SetInsertPoint(resume_block);
+            CallInst* gli = builder.CreateCall(the_module->getFunction("get_lasti"),
+                                               func_f);
+            to_inline.push_back(gli);
+            Value* lastipp = builder.CreateAdd(gli, constant(1));
+            builder.CreateStore(lastipp, dispatch_var);
+            SwitchInst* resume_switch = builder.CreateSwitch(gli, dispatch_block);
+            resume_switch->addCase(constant(-1), opblocks[0]);
+            for (size_t i = 0; i < yield_lines.size(); ++i)
+                resume_switch->addCase(constant(yield_lines[i]), opblocks[yield_lines[i] + 1]);
+        }
+        else {
+            // only generators are ever re-entered or thrown into, other
+            // frames start at the first instruction, or at the loop
+            // header where loop_back_edge() moved them to this code
+            std::vector<bool> headers = loop_headers(bytecode, codelen);
+            CallInst* gli = builder.CreateCall(the_module->getFunction("get_lasti"),
+                                               func_f);
+            to_inline.push_back(gli);
+            SwitchInst* entry_switch = builder.CreateSwitch(gli, opblocks[0]);
+            for (int start = 1; start < codelen; ++start)
+                if (headers[start] && opblocks[start])
+                    entry_switch->addCase(constant(start), opblocks[start]);
+        }
 
         builder.SetInsertPoint(gen_throw_block);
         to_inline.push_back(builder.CreateCall2(the_module->getFunction("set_why"), st_var, constant(WHY_EXCEPTION)));
         builder.CreateBr(block_end_block);
         
         // fill in the opcode blocks
-        for (const uint8_t* cur_instr = bytecode; *cur_instr; ++cur_instr) {
-            int line = cur_instr - bytecode;
-            unsigned int opcode = *cur_instr;
-            unsigned int oparg = 0;
-            if (HAS_ARG(opcode)) {
-                unsigned int arg1 = *++cur_instr;
-                unsigned int arg2 = *++cur_instr;
-                oparg = (arg2 << 8) + arg1;
-            }
-
-            builder.SetInsertPoint(opblocks[line]);
+        for (int start = 0; start < codelen && bytecode[start]; ) {
+            Instr in = decode_instr(bytecode, codelen, start);
+            int line = in.line;
+            unsigned int opcode = in.opcode;
+            unsigned int oparg = in.oparg;
+            int next_line = in.next;
+
+            builder.SetInsertPoint(opblocks[start]);
+            if (stores[start])
+                to_inline.push_back(builder.CreateCall2(set_lasti, func_f, constant(line)));
+            start = next_line;
 
             std::vector<Value*> opcode_args = vector_of
                 (st_var)
@@ -238,48 +846,225 @@ public:
             /**/
       
             switch(opcode) {
-            case YIELD_VALUE: // XXX this will have to change (trace?)
+            case SETUP_LOOP:
+            case SETUP_EXCEPT:
+            case SETUP_FINALLY:
+                if (!static_blocks || blocks.block_at[next_line] < 0) { // dead code
+                    DEFAULT_HANDLER;
+                    builder.CreateCondBr(is_zero(builder, opret), opblocks[next_line], block_end_block);
+                    break;
+                }
+                opcode_args[3] = constant(blocks.blocks[blocks.block_at[next_line]].b_depth);
+                opret = builder.CreateCall(setup_block_static, opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                to_inline.push_back(opret);
+                builder.CreateBr(opblocks[next_line]);
+                break;
+            case POP_BLOCK:
+                if (!static_blocks || blocks.block_at[line] < 0) {
+                    DEFAULT_HANDLER;
+                    builder.CreateCondBr(is_zero(builder, opret), opblocks[next_line], block_end_block);
+                    break;
+                }
+                opcode_args[3] = constant(blocks.blocks[blocks.block_at[line]].b_depth);
+                opret = builder.CreateCall(pop_block_static, opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                to_inline.push_back(opret);
+                builder.CreateBr(opblocks[next_line]);
+                break;
+            case BREAK_LOOP: {
+                // break out of a loop, unless a finally clause has to run
+                // first, is a plain jump to the end of the loop
+                int cur = static_blocks ? blocks.block_at[line] : -1;
+                int loop = blocks.enclosing_loop(cur);
+                if (loop < 0 || blocks.finally_between(cur, loop)) {
+                    DEFAULT_HANDLER;
+                    builder.CreateBr(block_end_block);
+                    break;
+                }
+                opcode_args[3] = constant(blocks.blocks[loop].b_depth);
+                opret = builder.CreateCall(pop_block_static, opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                to_inline.push_back(opret);
+                builder.CreateBr(opblocks[blocks.blocks[loop].b_handler]);
+                break;
+            }
+            case CONTINUE_LOOP: {
+                // same for a continue inside a try block: pop the blocks
+                // nested in the loop and jump back to its start
+                int cur = static_blocks ? blocks.block_at[line] : -1;
+                int loop = blocks.enclosing_loop(cur);
+                if (loop < 0 || cur == loop || blocks.finally_between(cur, loop)) {
+                    DEFAULT_HANDLER;
+                    builder.CreateBr(block_end_block);
+                    break;
+                }
+                int outermost = cur;
+                while (blocks.blocks[outermost].b_parent != loop)
+                    outermost = blocks.blocks[outermost].b_parent;
+                opcode_args[3] = constant(blocks.blocks[outermost].b_depth);
+                opret = builder.CreateCall(pop_block_static, opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                to_inline.push_back(opret);
+                builder.CreateBr(opblocks[oparg]);
+                break;
+            }
+            case GET_ITER: {
+                if (presized[in.start]) {
+                    opret = builder.CreateCall(get_iter_presized, opcode_args.begin(), opcode_args.end());
+                    opret->setCallingConv(CallingConv::Fast);
+                } else {
+                    DEFAULT_HANDLER;
+                }
+                builder.CreateCondBr(is_zero(builder, opret), opblocks[next_line], block_end_block);
+                break;
+            }
+            case BUILD_TUPLE:
+            case BUILD_LIST: {
+                // BUILD_TUPLE n; UNPACK_SEQUENCE n (a, b, c, d = d, c, b, a)
+                // never lets the sequence escape: reverse the n values on
+                // the stack instead of allocating it. The compiler only
+                // rewrites n <= 3 tuples to rotations.
+                bool escapes = next_line >= codelen || targets[next_line];
+                Instr unpack = in;
+                if (!escapes) {
+                    unpack = decode_instr(bytecode, codelen, next_line);
+                    escapes = unpack.opcode != UNPACK_SEQUENCE || unpack.oparg != oparg;
+                }
+                if (escapes) {
+                    DEFAULT_HANDLER;
+                    builder.CreateCondBr(is_zero(builder, opret), opblocks[next_line], block_end_block);
+                    break;
+                }
+                opret = builder.CreateCall(reverse_stack, opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                to_inline.push_back(opret);
+                builder.CreateBr(opblocks[unpack.next]);
+                break;
+            }
+            case CALL_FUNCTION: {
+                const FunctionType* fty = call_function_cached->getFunctionType();
+                opcode_args.push_back(constant_ptr(&data.call_caches[n_call_caches++],
+                                                   fty->getParamType(4)));
+                opret = builder.CreateCall(call_function_cached, opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                builder.CreateCondBr(is_zero(builder, opret), opblocks[next_line], block_end_block);
+                break;
+            }
+            case BINARY_SUBSCR:
+            case STORE_SUBSCR: {
+                Function* ophandler = opcode == BINARY_SUBSCR ? binary_subscr_cached : store_subscr_cached;
+                opcode_args.push_back(constant_ptr(&data.subscr_caches[n_subscr_caches++],
+                                                   ophandler->getFunctionType()->getParamType(4)));
+                opret = builder.CreateCall(ophandler, opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                to_inline.push_back(opret);
+                builder.CreateCondBr(is_zero(builder, opret), opblocks[next_line], block_end_block);
+                break;
+            }
+            case LOAD_GLOBAL: {
+                opcode_args.push_back(constant_ptr(&data.global_caches[n_global_caches++],
+                                                   load_global_cached->getFunctionType()->getParamType(4)));
+                opret = builder.CreateCall(load_global_cached, opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                to_inline.push_back(opret);
+                builder.CreateCondBr(is_zero(builder, opret), opblocks[next_line], block_end_block);
+                break;
+            }
+            case LOAD_ATTR: {
+                opcode_args.push_back(constant_ptr(&data.attr_caches[n_attr_caches++],
+                                                   load_attr_cached->getFunctionType()->getParamType(4)));
+                opret = builder.CreateCall(load_attr_cached, opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                to_inline.push_back(opret);
+                builder.CreateCondBr(is_zero(builder, opret), opblocks[next_line], block_end_block);
+                break;
+            }
+            case BINARY_ADD:
+            case BINARY_SUBTRACT:
+            case BINARY_MULTIPLY:
+            case BINARY_DIVIDE:
+            case BINARY_TRUE_DIVIDE:
+            case BINARY_FLOOR_DIVIDE:
+            case BINARY_MODULO: {
+                // operators on instances of classes go through the cache,
+                // everything else to the regular handler
+                BasicBlock* generic_block = BasicBlock::Create("binop_generic", func);
+                std::vector<Value*> cached_args(opcode_args);
+                cached_args.push_back(constant_ptr(&data.binop_caches[n_binop_caches++],
+                                                   binary_op_cached->getFunctionType()->getParamType(4)));
+                opret = builder.CreateCall(binary_op_cached, cached_args.begin(), cached_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                to_inline.push_back(opret);
+                SwitchInst* sw = builder.CreateSwitch(opret, block_end_block);
+                sw->addCase(constant(0), opblocks[next_line]);
+                sw->addCase(constant(2), generic_block);
+                builder.SetInsertPoint(generic_block);
+                DEFAULT_HANDLER;
+                builder.CreateCondBr(is_zero(builder, opret), opblocks[next_line], block_end_block);
+                break;
+            }
+            case YIELD_VALUE:
+                // the handler saved the value stack in f_stacktop, there
+                // is nothing to unwind: leave the frame right away
+                DEFAULT_HANDLER;
+                builder.CreateBr(end_block);
+                break;
             case RETURN_VALUE:
                 DEFAULT_HANDLER;
                 builder.CreateBr(block_end_block);
                 break;
             case JUMP_FORWARD: {
-                int next_line = line + 3 + oparg; // 3 is JUMP_FORWARD + oparg
-                assert(next_line < codelen);
-                builder.CreateBr(opblocks[next_line]);
+                assert(next_line + oparg < codelen);
+                builder.CreateBr(opblocks[next_line + oparg]);
                 break;
             }
             case JUMP_ABSOLUTE: {
-                builder.CreateBr(opblocks[oparg]);
+                BasicBlock* jump_block = opblocks[oparg];
+                if (profiling && (int)oparg <= in.start)
+                    jump_block = loop_edge(func, st_var, &data.backedges, oparg, jump_block,
+                                           is_generator ? 0 : end_block);
+                builder.CreateBr(jump_block);
                 break;
             }
             case JUMP_IF_TRUE:
             case JUMP_IF_FALSE: {
-                int true_line = line + 3;
-                int false_line = line + 3 + oparg;
-                if (opcode == JUMP_IF_TRUE) std::swap(true_line, false_line);
+                BasicBlock* jump_block = opblocks[next_line + oparg];
+                BasicBlock* next_block = opblocks[next_line];
+                if (profiling) {
+                    jump_block = counted_edge(func, &data.branch_profile[in.start].taken, jump_block);
+                    next_block = counted_edge(func, &data.branch_profile[in.start].not_taken, next_block);
+                }
                 CallInst* cond = builder.CreateCall(is_top_true, st_var);
                 cond->setCallingConv(CallingConv::Fast);
                 to_inline.push_back(cond);
-                builder.CreateCondBr(is_zero(builder, cond), opblocks[false_line], opblocks[true_line]);
+                if (opcode == JUMP_IF_TRUE)
+                    builder.CreateCondBr(is_zero(builder, cond), next_block, jump_block);
+                else
+                    builder.CreateCondBr(is_zero(builder, cond), jump_block, next_block);
                 break;
             }
 
             case FOR_ITER: {
+                BasicBlock* end_loop_block = opblocks[next_line + oparg];
+                BasicBlock* next_block = opblocks[next_line];
+                if (profiling) {
+                    end_loop_block = counted_edge(func, &data.branch_profile[in.start].taken, end_loop_block);
+                    next_block = counted_edge(func, &data.branch_profile[in.start].not_taken, next_block);
+                }
                 opret = builder.CreateCall(opcode_funcs[opcode], opcode_args.begin(), opcode_args.end());
                 opret->setCallingConv(CallingConv::Fast);       
                 to_inline.push_back(opret);
                 SwitchInst* sw = builder.CreateSwitch(opret, block_end_block);
                 sw->addCase(constant(1), block_end_block); // error
-                sw->addCase(constant(0), opblocks[line + 3]); // continue loop
-                sw->addCase(constant(2), opblocks[line + 3 + oparg]); // end loop
+                sw->addCase(constant(0), next_block); // continue loop
+                sw->addCase(constant(2), end_loop_block); // end loop
                 break;
             }
                 
             default: {
                 DEFAULT_HANDLER;
-                int next_line = line + (HAS_ARG(opcode) ? 3 : 1);
-                if (next_line < codelen)
+                if (next_line < codelen && bytecode[next_line])
                     builder.CreateCondBr(is_zero(builder, opret), opblocks[next_line], block_end_block);
                 else
                     builder.CreateBr(block_end_block);
@@ -290,11 +1075,35 @@ public:
         
         builder.SetInsertPoint(block_end_block);
         
-        CallInst* do_jump = builder.CreateCall2(unwind_stack, st_var, dispatch_var);
+        CallInst* do_jump;
+        if (static_blocks) {
+            const FunctionType* fty = unwind_stack_static->getFunctionType();
+            do_jump = builder.CreateCall4(unwind_stack_static, st_var, dispatch_var,
+                                          constant_ptr(blocks.blocks.empty() ? 0 : &blocks.blocks[0],
+                                                       fty->getParamType(2)),
+                                          constant_ptr(&blocks.block_at[0], fty->getParamType(3)));
+        }
+        else
+            do_jump = builder.CreateCall2(unwind_stack, st_var, dispatch_var);
         do_jump->setCallingConv(CallingConv::Fast);
         //to_inline.push_back(do_jump);
         builder.CreateCondBr(is_zero(builder, do_jump), dispatch_block, end_block);
 
+        if (use_profile) {
+            // Move the code that never ran while profiling out of line,
+            // behind the unwinding code, so that the hot paths fall
+            // through. LLVM lays out blocks in function order.
+            std::vector<bool> hot = hot_code(bytecode, codelen, data.branch_profile);
+            BasicBlock* tail = block_end_block;
+            for (int start = 0; start < codelen && bytecode[start];
+                 start = decode_instr(bytecode, codelen, start).next) {
+                if (!hot[start]) {
+                    opblocks[start]->moveAfter(tail);
+                    tail = opblocks[start];
+                }
+            }
+        }
+
         //verify_function(func);
 
         if (inlineopcodes) {
@@ -306,6 +1115,26 @@ public:
         return func;
     }
 
+    // The interpreter tier: a single function with the signature of
+    // jitted code that decodes the bytecode of any frame at run time and
+    // dispatches to the same opcode handlers. Built on first use.
+    llvm::Function* interpreter() {
+        if (!interpreter_func)
+            interpreter_func = build_interpreter(false);
+        return interpreter_func;
+    }
+
+    // The interpreter tier with line and exception events for
+    // sys.settrace(), which runs all frames while a trace function is
+    // set. Compiled code carries no tracing at all.
+    jitted_cfunc_t traced_interpreter() {
+        if (!traced_interpreter_func)
+            traced_interpreter_func = get_func_pointer(build_interpreter(true));
+        return traced_interpreter_func;
+    }
+
+    jit_stats_t stats;
+
     void verify_function(llvm::Function* func) {
         PMverifier.run(*func->getParent());
     }
@@ -315,7 +1144,172 @@ public:
         return cfunc;
     }
 
+    // Generate machine code for every function of the module with a
+    // body: the opcode handlers that compiled code calls are then called
+    // directly, rather than through lazy stubs that get patched on their
+    // first call.
+    void compile_module() {
+        using namespace llvm;
+        for (Module::iterator f = the_module->begin(), e = the_module->end(); f != e; ++f)
+            if (!f->isDeclaration())
+                EE->getPointerToFunction(f);
+    }
+
 protected:
+    static bool is_jump(unsigned int opcode) {
+        return opcode == JUMP_FORWARD || opcode == JUMP_ABSOLUTE ||
+            opcode == JUMP_IF_TRUE || opcode == JUMP_IF_FALSE;
+    }
+
+    llvm::Function* build_interpreter(bool traced) {
+        using namespace llvm;
+
+        Function* func = Function::Create(ty_jitted_function, Function::ExternalLinkage,
+                                          traced ? "traced_interpreter" : "interpreter", the_module);
+        Function::arg_iterator func_args = func->arg_begin();
+        Value* func_f = func_args++;
+        func_f->setName("f");
+        Value* func_tstate = func_args++;
+        func_tstate->setName("tstate");
+        Value* func_throwflag = func_args++;
+        func_throwflag->setName("throwflag");
+
+        std::vector<CallInst*> to_inline;
+
+        BasicBlock* entry = BasicBlock::Create("entry", func);
+        BasicBlock* gen_throw_block = BasicBlock::Create("gen_throw", func);
+        BasicBlock* fetch_block = BasicBlock::Create("fetch", func);
+        BasicBlock* unimplemented_block = BasicBlock::Create("unimplemented", func);
+        BasicBlock* block_end_block = BasicBlock::Create("block_end", func);
+        BasicBlock* end_block = BasicBlock::Create("end", func);
+
+        IRBuilder<> builder(entry);
+        Value* st_var = builder.CreateAlloca(the_module->getTypeByName("struct.interpreter_state"), 0, "st");
+        to_inline.push_back(builder.CreateCall3(the_module->getFunction("init_interpreter_state"), st_var, func_f, func_tstate));
+        Value* next_var = builder.CreateAlloca(Type::Int32Ty, 0, "next_instr");
+        Value* line_var = builder.CreateAlloca(Type::Int32Ty, 0, "line");
+        Value* oparg_var = builder.CreateAlloca(Type::Int32Ty, 0, "oparg");
+        CallInst* gli = builder.CreateCall(the_module->getFunction("get_lasti"), func_f);
+        to_inline.push_back(gli);
+        builder.CreateStore(builder.CreateAdd(gli, constant(1)), next_var);
+        builder.CreateCondBr(is_zero(builder, func_throwflag), fetch_block, gen_throw_block);
+
+        builder.SetInsertPoint(gen_throw_block);
+        to_inline.push_back(builder.CreateCall2(the_module->getFunction("set_why"), st_var, constant(WHY_EXCEPTION)));
+        builder.CreateBr(block_end_block);
+
+        builder.SetInsertPoint(end_block);
+        CallInst* retval = builder.CreateCall(the_module->getFunction("get_retval"), st_var);
+        to_inline.push_back(retval);
+        builder.CreateRet(retval);
+
+        builder.SetInsertPoint(fetch_block);
+        CallInst* opcode_val = builder.CreateCall4(the_module->getFunction(traced ? "fetch_instr_traced" : "fetch_instr"),
+                                                   st_var, next_var, line_var, oparg_var);
+        to_inline.push_back(opcode_val);
+        Value* line = builder.CreateLoad(line_var);
+        Value* oparg = builder.CreateLoad(oparg_var);
+        SwitchInst* opcode_switch = builder.CreateSwitch(opcode_val, unimplemented_block);
+        if (traced)
+            opcode_switch->addCase(constant(0), block_end_block); // the trace function failed
+
+        for (unsigned int opcode = 1; opcode < 256; ++opcode) {
+            if (!opcode_funcs.count(opcode) && !is_jump(opcode))
+                continue;
+
+            char opblockname[20];
+            sprintf(opblockname, "__opcode_%d", opcode);
+            BasicBlock* opblock = BasicBlock::Create(std::string(opblockname), func);
+            opcode_switch->addCase(constant(opcode), opblock);
+            builder.SetInsertPoint(opblock);
+
+            std::vector<Value*> opcode_args = vector_of
+                (st_var)
+                (line)
+                (constant(opcode))
+                (oparg)
+                .move();
+            Value* next = builder.CreateLoad(next_var);
+            CallInst* opret;
+
+            switch (opcode) {
+            case JUMP_FORWARD:
+                builder.CreateStore(builder.CreateAdd(next, oparg), next_var);
+                builder.CreateBr(fetch_block);
+                break;
+            case JUMP_ABSOLUTE: {
+                builder.CreateStore(oparg, next_var);
+                if (traced) {
+                    builder.CreateBr(fetch_block);
+                    break;
+                }
+                // count the iterations of loops toward compiling the code
+                BasicBlock* back_block = BasicBlock::Create("loop_back_edge", func);
+                builder.CreateCondBr(builder.CreateICmpSLE(oparg, line), back_block, fetch_block);
+                builder.SetInsertPoint(back_block);
+                Value* moved = builder.CreateCall3(the_module->getFunction("loop_back_edge"),
+                                                   st_var, oparg, constant(0));
+                builder.CreateCondBr(is_zero(builder, moved), fetch_block, end_block);
+                break;
+            }
+            case JUMP_IF_TRUE:
+            case JUMP_IF_FALSE: {
+                CallInst* cond = builder.CreateCall(is_top_true, st_var);
+                cond->setCallingConv(CallingConv::Fast);
+                Value* stay = is_zero(builder, cond);
+                if (opcode == JUMP_IF_FALSE)
+                    stay = builder.CreateNot(stay);
+                builder.CreateStore(builder.CreateSelect(stay, next, builder.CreateAdd(next, oparg)), next_var);
+                builder.CreateBr(fetch_block);
+                break;
+            }
+            case FOR_ITER: {
+                BasicBlock* loop_end = BasicBlock::Create("for_iter_end", func);
+                opret = builder.CreateCall(opcode_funcs[opcode], opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                SwitchInst* sw = builder.CreateSwitch(opret, block_end_block);
+                sw->addCase(constant(0), fetch_block); // continue loop
+                sw->addCase(constant(2), loop_end); // end loop
+                builder.SetInsertPoint(loop_end);
+                builder.CreateStore(builder.CreateAdd(next, oparg), next_var);
+                builder.CreateBr(fetch_block);
+                break;
+            }
+            case YIELD_VALUE:
+                opret = builder.CreateCall(opcode_funcs[opcode], opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                builder.CreateBr(end_block);
+                break;
+            default:
+                opret = builder.CreateCall(opcode_funcs[opcode], opcode_args.begin(), opcode_args.end());
+                opret->setCallingConv(CallingConv::Fast);
+                builder.CreateCondBr(is_zero(builder, opret), fetch_block, block_end_block);
+                break;
+            }
+        }
+
+        builder.SetInsertPoint(unimplemented_block);
+        std::vector<Value*> unimplemented_args = vector_of
+            (st_var)
+            (line)
+            (opcode_val)
+            (oparg)
+            .move();
+        CallInst* unimplemented = builder.CreateCall(opcode_unimplemented, unimplemented_args.begin(), unimplemented_args.end());
+        unimplemented->setCallingConv(CallingConv::Fast);
+        builder.CreateBr(block_end_block);
+
+        builder.SetInsertPoint(block_end_block);
+        CallInst* do_jump = builder.CreateCall2(traced ? unwind_stack_traced : unwind_stack, st_var, next_var);
+        do_jump->setCallingConv(CallingConv::Fast);
+        builder.CreateCondBr(is_zero(builder, do_jump), fetch_block, end_block);
+
+        for (size_t i = 0; i < to_inline.size(); ++i)
+            InlineFunction(to_inline[i]);
+        FPM->run(*func);
+        return func;
+    }
+
     void register_opcodes() {
         using namespace llvm;
         fat_opcode.resize(256, false);
@@ -344,7 +1338,9 @@ protected:
         REGISTER_OPCODE(YIELD_VALUE);
         REGISTER_OPCODE(LOAD_CONST);
         REGISTER_OPCODE(PRINT_ITEM);
+        REGISTER_OPCODE(PRINT_ITEM_TO);
         REGISTER_OPCODE(PRINT_NEWLINE);
+        REGISTER_OPCODE(PRINT_NEWLINE_TO);
         REGISTER_OPCODE(PRINT_EXPR);
         REGISTER_OPCODE(LOAD_NAME);
         REGISTER_OPCODE(DELETE_NAME);
@@ -363,6 +1359,7 @@ protected:
         REGISTER_ALIAS(SETUP_EXCEPT, SETUP_LOOP);
         REGISTER_ALIAS(SETUP_FINALLY, SETUP_LOOP);
         REGISTER_OPCODE(RAISE_VARARGS);
+        REGISTER_OPCODE(WITH_CLEANUP);
 
         REGISTER_OPCODE(BUILD_LIST);
         REGISTER_OPCODE(BUILD_TUPLE);
@@ -373,6 +1370,7 @@ protected:
         REGISTER_OPCODE(FOR_ITER); // XXX?
         REGISTER_OPCODE(UNPACK_SEQUENCE);
         REGISTER_OPCODE(BREAK_LOOP);
+        REGISTER_OPCODE(CONTINUE_LOOP);
 
         REGISTER_OPCODE(POP_BLOCK);
         REGISTER_OPCODE(END_FINALLY);
@@ -386,6 +1384,8 @@ protected:
         REGISTER_ALIAS(CALL_FUNCTION_VAR_KW, CALL_FUNCTION_VAR);
 
         REGISTER_OPCODE(LOAD_ATTR);
+        REGISTER_OPCODE(LOAD_METHOD);
+        REGISTER_OPCODE(CALL_METHOD);
         REGISTER_OPCODE(STORE_ATTR);
         REGISTER_OPCODE(DELETE_ATTR);
 
@@ -398,6 +1398,7 @@ protected:
         
         REGISTER_OPCODE(LOAD_GLOBAL);
         REGISTER_OPCODE(STORE_GLOBAL);
+        REGISTER_OPCODE(DELETE_GLOBAL);
 
         REGISTER_OPCODE(BINARY_SUBSCR);
         REGISTER_OPCODE(STORE_SUBSCR);
@@ -417,6 +1418,7 @@ protected:
         REGISTER_OPCODE(BINARY_ADD);
         REGISTER_OPCODE(BINARY_SUBTRACT);
         
+        REGISTER_OPCODE(BUILD_SLICE);
         REGISTER_OPCODE(SLICE);
         REGISTER_ALIAS(SLICE+0, SLICE);
         REGISTER_ALIAS(SLICE+1, SLICE);
@@ -473,6 +1475,19 @@ protected:
     llvm::Function* opcode_unimplemented;
     llvm::Function* is_top_true;
     llvm::Function* unwind_stack;
+    llvm::Function* unwind_stack_traced;
+    llvm::Function* unwind_stack_static;
+    llvm::Function* setup_block_static;
+    llvm::Function* pop_block_static;
+    llvm::Function* reverse_stack;
+    llvm::Function* get_iter_presized;
+    llvm::Function* set_lasti;
+    llvm::Function* call_function_cached;
+    llvm::Function* binary_subscr_cached;
+    llvm::Function* store_subscr_cached;
+    llvm::Function* binary_op_cached;
+    llvm::Function* load_global_cached;
+    llvm::Function* load_attr_cached;
 
     const llvm::Type* ty_pyobject_ptr;
     const llvm::Type* ty_pyframe_ptr;
@@ -480,6 +1495,65 @@ protected:
 
     llvm::FunctionType* ty_jitted_function;
 
+    llvm::Function* interpreter_func;
+    jitted_cfunc_t traced_interpreter_func;
+
+    // A block on the way to dest that counts in *counter how often the
+    // edge is taken.
+    llvm::BasicBlock* counted_edge(llvm::Function* func, uint32_t* counter, llvm::BasicBlock* dest) {
+        using namespace llvm;
+        BasicBlock* bb = BasicBlock::Create("count", func);
+        IRBuilder<> builder(bb);
+        increment(builder, counter);
+        builder.CreateBr(dest);
+        return bb;
+    }
+
+    // The same for the jump back to the loop header at offset target,
+    // counted in *counter. Once the loop ran JIT_PROFILE_EDGES times,
+    // loop_back_edge() continues the frame in the code compiled for it
+    // meanwhile, and the function returns through exit; without exit
+    // (generators, which can't be entered at a loop header) the loop
+    // only counts.
+    llvm::BasicBlock* loop_edge(llvm::Function* func, llvm::Value* st_var, uint32_t* counter,
+                                int target, llvm::BasicBlock* dest, llvm::BasicBlock* exit) {
+        using namespace llvm;
+        BasicBlock* bb = BasicBlock::Create("loop_count", func);
+        IRBuilder<> builder(bb);
+        Value* n = increment(builder, counter);
+        if (!exit) {
+            builder.CreateBr(dest);
+            return bb;
+        }
+        BasicBlock* hot_block = BasicBlock::Create("loop_hot", func);
+        builder.CreateCondBr(builder.CreateICmpULT(n, constant(JIT_PROFILE_EDGES)), dest, hot_block);
+        builder.SetInsertPoint(hot_block);
+        Value* moved = builder.CreateCall3(the_module->getFunction("loop_back_edge"),
+                                           st_var, constant(target), constant(1));
+        builder.CreateCondBr(is_zero(builder, moved), dest, exit);
+        return bb;
+    }
+
+    // Add one to *counter, unless that would wrap it around to 0: a hot
+    // edge must not look like one never taken. Returns the new count.
+    template<typename Builder>
+    llvm::Value* increment(Builder& builder, uint32_t* counter) {
+        using namespace llvm;
+        Value* p = constant_ptr(counter, PointerType::getUnqual(Type::Int32Ty));
+        Value* n = builder.CreateLoad(p);
+        Value* inc = builder.CreateAdd(n, constant(1));
+        inc = builder.CreateSelect(is_zero(builder, inc), n, inc);
+        builder.CreateStore(inc, p);
+        return inc;
+    }
+
+    // A pointer into our own address space, as a constant of type ty.
+    llvm::Constant* constant_ptr(const void* p, const llvm::Type* ty) {
+        using namespace llvm;
+        Constant* addr = ConstantInt::get(EE->getTargetData()->getIntPtrType(), (intptr_t)p);
+        return ConstantExpr::getIntToPtr(addr, ty);
+    }
+
     std::string make_function_name(PyCodeObject* co) {
         std::ostringstream os;
         os << "bytecode_at_";
@@ -490,10 +1564,38 @@ protected:
 
 JITRuntime* jit = 0;
 
+extern "C" {
+    volatile int jit_sample_pending = 0;
+    void (*jit_sample_hook)(PyThreadState* tstate) = 0;
+}
+
+// Branch profiles are kept in a file next to the .pyc of a module
+// (foo.pyj for foo.pyc): a dict from profile_key() of each code object
+// run often enough to be profiled to the list of (offset, taken,
+// not_taken) of its branches. Code that has a profile starts out like
+// any other, but when it leaves the baseline tier it is compiled laid
+// out by the profile, without a profiling tier. With
+// PYTHONJITPROFILE set the profiles collected are written back when
+// the interpreter exits.
+static bool save_profiles = false;
+static PyObject* profile_paths = NULL;   // co_filename -> .pyj path
+static PyObject* saved_profiles = NULL;  // .pyj path -> profiles
+
+// The code object a profile belongs to: the same name, first line and
+// bytecode.
+static PyObject* profile_key(PyCodeObject* co) {
+    long hash = PyObject_Hash(co->co_code);
+    if (hash == -1)
+        return NULL;
+    return Py_BuildValue("(Oil)", co->co_name, co->co_firstlineno, hash);
+}
+
 extern "C"
 void init_jit_runtime() 
 {
     jit = new JITRuntime(1);
+    const char* p = Py_GETENV("PYTHONJITPROFILE");
+    save_profiles = p != NULL && *p != '\0';
 }
 
 extern "C"
@@ -504,11 +1606,77 @@ void finalize_jit_runtime()
 }
 
 struct PyJittedFunc {
-    PyJittedFunc(PyCodeObject* co) {
+    // Not started yet: data.branch_profile is filled from a .pyj file
+    PyJittedFunc()
+        : func(0), cfunc(0), baseline(false), profiling(false),
+          saved_profile(true), calls(0) {}
+
+    PyJittedFunc(PyCodeObject* co, bool profile = true)
+        : baseline(false), profiling(false), saved_profile(false), calls(0) {
+        start(co, profile);
+    }
+
+    // Pick the first tier of co: the baseline tier if profile, else
+    // compiled code for good.
+    void start(PyCodeObject* co, bool profile) {
+        if (profile) {
+            baseline = true;
+            func = jit->interpreter();
+            cfunc = jit->get_func_pointer(func);
+            ++jit->stats.baseline;
+        }
+        else
+            compile(co, false);
+    }
+
+    // Compile the code, with branch counters if profile.
+    void compile(PyCodeObject* co, bool profile) {
         //printf("Compiling %s in %s:%d\n", PyString_AS_STRING(co->co_name), PyString_AS_STRING(co->co_filename), co->co_firstlineno);
-        func = jit->compile(co);
+        func = jit->compile(co, data, 1, profile);
         //func->dump();
         cfunc = jit->get_func_pointer(func);
+        baseline = false;
+        profiling = profile;
+        calls = 0;
+        data.backedges = 0;
+        ++jit->stats.compiled;
+    }
+
+    // Replace the profiling code by code laid out by its profile. The
+    // old code is kept, frames further up the stack may be running it;
+    // both versions share data.
+    void recompile(PyCodeObject* co) {
+        func = jit->compile(co, data);
+        cfunc = jit->get_func_pointer(func);
+        profiling = false;
+        ++jit->stats.recompiled;
+        if (save_profiles)
+            save_profile(co);
+    }
+
+    // Keep the profile of co for write_jit_profiles(), if its module
+    // was imported from a file.
+    void save_profile(PyCodeObject* co) {
+        PyObject* path = profile_paths ? PyDict_GetItem(profile_paths, co->co_filename) : NULL;
+        if (path == NULL)
+            return;
+        PyObject* profiles = PyDict_GetItem(saved_profiles, path);
+        PyObject* key = profile_key(co);
+        PyObject* branches = PyList_New(0);
+        for (size_t i = 0; branches != NULL && i < data.branch_profile.size(); ++i) {
+            const BranchProfile& p = data.branch_profile[i];
+            if (!p.taken && !p.not_taken)
+                continue;
+            PyObject* branch = Py_BuildValue("(ill)", (int)i, (long)p.taken, (long)p.not_taken);
+            if (branch == NULL || PyList_Append(branches, branch) < 0)
+                Py_CLEAR(branches);
+            Py_XDECREF(branch);
+        }
+        if (profiles != NULL && key != NULL && branches != NULL)
+            PyDict_SetItem(profiles, key, branches);
+        Py_XDECREF(key);
+        Py_XDECREF(branches);
+        PyErr_Clear();
     }
     
     ~PyJittedFunc() {
@@ -517,17 +1685,203 @@ struct PyJittedFunc {
         //func->eraseFromParent(); // XXX is this enough?? what about machine code?
     }
     
-    llvm::Function* func;
+    llvm::Function* func;   // the interpreter tier's while baseline
     jitted_cfunc_t cfunc;
+    CodeData data;
+    bool baseline;          // until compiled after JIT_BASELINE_CALLS/EDGES
+    bool profiling;         // cfunc counts branches into data
+    bool saved_profile;     // data.branch_profile came from a .pyj
+    unsigned int calls;
 };
 
+// Give co and the code objects nested in it the profiles found for them
+// in a .pyj file. They start out in the baseline tier on their first
+// call.
+static void attach_profiles(PyCodeObject* co, PyObject* profiles) {
+    PyObject* key = profile_key(co);
+    PyObject* branches = key ? PyDict_GetItem(profiles, key) : NULL;
+    Py_XDECREF(key);
+    if (branches != NULL && PyList_Check(branches) &&
+        co->co_jitted == NULL) {
+        Py_ssize_t codelen = PyString_GET_SIZE(co->co_code);
+        PyJittedFunc* jf = new PyJittedFunc();
+        jf->data.branch_profile.resize(codelen);
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(branches); ++i) {
+            int offset;
+            long taken, not_taken;
+            if (!PyArg_ParseTuple(PyList_GET_ITEM(branches, i), "ill", &offset, &taken, &not_taken) ||
+                offset < 0 || offset >= codelen)
+                continue;
+            jf->data.branch_profile[offset].taken = taken;
+            jf->data.branch_profile[offset].not_taken = not_taken;
+        }
+        co->co_jitted = (void*) jf;
+    }
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(co->co_consts); ++i) {
+        PyObject* c = PyTuple_GET_ITEM(co->co_consts, i);
+        if (PyCode_Check(c))
+            attach_profiles((PyCodeObject*)c, profiles);
+    }
+}
+
+extern "C"
+void load_jit_profiles(PyCodeObject* co, const char* path)
+{
+    assert(jit);
+    PyObject* profiles = NULL;
+    FILE* fp = fopen(path, "rb");
+    if (fp != NULL) {
+        if (PyMarshal_ReadLongFromFile(fp) == PyImport_GetMagicNumber())
+            profiles = PyMarshal_ReadLastObjectFromFile(fp);
+        fclose(fp);
+    }
+    if (profiles != NULL && PyDict_Check(profiles))
+        attach_profiles(co, profiles);
+    if (save_profiles) {
+        // profiles of code that doesn't run this time are written back
+        if (profile_paths == NULL) {
+            profile_paths = PyDict_New();
+            saved_profiles = PyDict_New();
+        }
+        PyObject* pathobj = PyString_FromString(path);
+        if (profiles == NULL || !PyDict_Check(profiles)) {
+            Py_XDECREF(profiles);
+            profiles = PyDict_New();
+        }
+        if (profile_paths != NULL && saved_profiles != NULL &&
+            pathobj != NULL && profiles != NULL &&
+            PyDict_SetItem(profile_paths, co->co_filename, pathobj) == 0)
+            PyDict_SetItem(saved_profiles, pathobj, profiles);
+        Py_XDECREF(pathobj);
+    }
+    Py_XDECREF(profiles);
+    // like a .pyc, a .pyj is only a cache
+    PyErr_Clear();
+}
+
+extern "C"
+void write_jit_profiles()
+{
+    Py_ssize_t pos = 0;
+    PyObject *path, *profiles;
+
+    if (saved_profiles == NULL)
+        return;
+    while (PyDict_Next(saved_profiles, &pos, &path, &profiles)) {
+        if (PyDict_Size(profiles) == 0)
+            continue;
+        // Every process of a prefork server writes the same file at exit:
+        // write a file of our own, never followed if it is a symlink, and
+        // rename it over the .pyj, so that readers see one whole profile.
+        std::ostringstream tmp;
+        tmp << PyString_AS_STRING(path) << "." << getpid() << ".tmp";
+        int fd = open(tmp.str().c_str(), O_EXCL | O_CREAT | O_WRONLY | O_TRUNC, 0666);
+        if (fd < 0)
+            continue;
+        FILE* fp = fdopen(fd, "wb");
+        if (fp == NULL) {
+            close(fd);
+            unlink(tmp.str().c_str());
+            continue;
+        }
+        PyMarshal_WriteLongToFile(PyImport_GetMagicNumber(), fp, Py_MARSHAL_VERSION);
+        PyMarshal_WriteObjectToFile(profiles, fp, Py_MARSHAL_VERSION);
+        if (fflush(fp) != 0 || ferror(fp)) {
+            fclose(fp);
+            unlink(tmp.str().c_str());
+            continue;
+        }
+        fclose(fp);
+        if (rename(tmp.str().c_str(), PyString_AS_STRING(path)) < 0)
+            unlink(tmp.str().c_str());
+    }
+    Py_CLEAR(saved_profiles);
+    Py_CLEAR(profile_paths);
+}
+
 extern "C"
 jitted_cfunc_t get_jitted_function(PyCodeObject* co) 
 {
     assert(jit);
     if (co->co_jitted == NULL)
         co->co_jitted = (void*) new PyJittedFunc(co);
-    return ((PyJittedFunc*)co->co_jitted)->cfunc;
+    PyJittedFunc* jf = (PyJittedFunc*)co->co_jitted;
+    if (jf->cfunc == NULL)
+        jf->start(co, true);  // with the profile of a .pyj
+    else if (jf->baseline) {
+        if (++jf->calls >= JIT_BASELINE_CALLS)
+            jf->compile(co, !jf->saved_profile);
+    }
+    else if (jf->profiling) {
+        if (++jf->calls >= JIT_PROFILE_CALLS || jf->data.backedges >= JIT_PROFILE_EDGES)
+            jf->recompile(co);
+    }
+    return jf->cfunc;
+}
+
+extern "C"
+jitted_cfunc_t jit_loop_tier_up(PyFrameObject* f, int counted)
+{
+    assert(jit);
+    PyCodeObject* co = f->f_code;
+    PyJittedFunc* jf = (PyJittedFunc*)co->co_jitted;
+    if (jf == NULL)
+        return NULL;
+    if (counted) {
+        if (jf->profiling)
+            jf->recompile(co);
+    }
+    else if (jf->baseline) {
+        if (++jf->data.backedges < JIT_BASELINE_EDGES)
+            return NULL;
+        jf->compile(co, !jf->saved_profile);
+    }
+    if (jf->baseline || (counted && jf->profiling) || (co->co_flags & CO_GENERATOR))
+        return NULL;
+    // the interpreter tier kept the blocks on f_blockstack, at the
+    // depths where compiled code expects them
+    if (jf->data.blocks.resolved)
+        f->f_iblock = 0;
+    return jf->cfunc;
+}
+
+extern "C"
+jitted_cfunc_t get_traced_function(PyCodeObject* co)
+{
+    assert(jit);
+    return jit->traced_interpreter();
+}
+
+extern "C"
+int precompile_jitted_function(PyCodeObject* co)
+{
+    assert(jit);
+    if (co->co_jitted == NULL) {
+        co->co_jitted = (void*) new PyJittedFunc(co, false);
+        return 1;
+    }
+    PyJittedFunc* jf = (PyJittedFunc*)co->co_jitted;
+    if (jf->baseline || jf->cfunc == NULL)
+        jf->compile(co, false);
+    else if (jf->profiling)
+        jf->recompile(co);
+    else
+        return 0;
+    return 1;
+}
+
+extern "C"
+void prepare_jit_for_precompile()
+{
+    assert(jit);
+    jit->compile_module();
+}
+
+extern "C"
+void get_jit_stats(jit_stats_t* stats)
+{
+    assert(jit);
+    *stats = jit->stats;
 }
 
 extern "C"
@@ -584,7 +1938,8 @@ int main(int argc, char** argv) {
 
     JITRuntime jit(optimize);
     // show LLVM bitcode
-    llvm::Function* cf = jit.compile(co, inlineopcodes);
+    CodeData data;
+    llvm::Function* cf = jit.compile(co, data, inlineopcodes);
     cf->dump();
 
     jit.verify_function(cf);
@@ -16,7 +16,55 @@ extern "C" {
     typedef PyObject* (*jitted_cfunc_t)(PyFrameObject*, PyThreadState*, int);
 
     jitted_cfunc_t get_jitted_function(PyCodeObject* co);
+    /* What runs co while sys.settrace() is active: the interpreter tier
+       with line and exception events */
+    jitted_cfunc_t get_traced_function(PyCodeObject* co);
     void finalize_jitted_function(PyCodeObject* co);
+    /* A loop of f jumps back, in the baseline tier or, once it iterated
+       often enough (counted), in code with branch counters: count it in
+       the baseline tier, and compile or recompile the code of f when
+       its loops are hot.  Returns the code to continue f in from the
+       loop header, or NULL to keep running the current code */
+    jitted_cfunc_t jit_loop_tier_up(PyFrameObject* f, int counted);
+
+    /* Compile co for good, without branch counters, ahead of its first
+       call; code compiled with counters is recompiled with the profile
+       collected so far.  Afterwards co is neither compiled again nor
+       counts its calls and branches, so that a process forking children
+       shares its machine code with them; only the inline caches get
+       written.  Returns 1 if co was compiled, 0 if it already was. */
+    int precompile_jitted_function(PyCodeObject* co);
+    /* Compile the opcode handlers ahead of precompile_jitted_function() */
+    void prepare_jit_for_precompile(void);
+
+    /* Branch profiles saved by earlier processes: co, just imported,
+       and its nested code objects get the profiles found for them in
+       the file at path (foo.pyj next to foo.pyc), and are compiled laid
+       out by them when they leave the baseline tier, without counting
+       their branches first.  With PYTHONJITPROFILE set, the
+       profiles collected in this process are written back to these
+       files by write_jit_profiles(), at exit.  Errors are ignored. */
+    void load_jit_profiles(PyCodeObject* co, const char* path);
+    void write_jit_profiles(void);
+
+    /* What happened to the code objects run so far (see the _jit module) */
+    typedef struct {
+        long compiled;      /* compiled to native code */
+        long recompiled;    /* compiled again with their branch profile */
+        long baseline;      /* run by the interpreter tier until called,
+                               or looping, often enough to compile */
+    } jit_stats_t;
+
+    void get_jit_stats(jit_stats_t* stats);
+
+    /* Sampling profiler support (see the _jit module).  Compiled code
+       keeps f_lasti at the first instruction of the current line, so
+       that the frames of a thread tell where it is.  Setting
+       jit_sample_pending (from a signal handler) makes the next periodic
+       check of the running thread call jit_sample_hook with its
+       tstate. */
+    extern volatile int jit_sample_pending;
+    extern void (*jit_sample_hook)(PyThreadState* tstate);
 
     /* Status code for main loop (reason for stack unwind) */
     enum why_code {
@@ -29,6 +77,99 @@ extern "C" {
         WHY_YIELD =	0x0040	/* 'yield' operator */
     };
 
+    /* Builtins that CALL_FUNCTION sites expand inline */
+    enum jit_intrinsic {
+        JIT_INTRINSIC_NONE = 0,
+        JIT_INTRINSIC_LEN,
+        JIT_INTRINSIC_ISINSTANCE,
+        JIT_INTRINSIC_ABS
+    };
+
+    /* Most keyword arguments a call site binds without PyEval_EvalCodeEx */
+#define JIT_MAX_CACHED_KWARGS 8
+
+    /* Inline cache of a CALL_FUNCTION site: the builtin function or
+       method called there last.  It is identified by its PyMethodDef, so
+       that bound methods of different objects (d.get for any dict d)
+       share an entry.  Sites with keyword arguments instead remember
+       which parameters of the Python function called last the keywords
+       bind to. */
+    typedef struct {
+        PyMethodDef* ml;  /* NULL until a builtin is called here */
+        int intrinsic;    /* enum jit_intrinsic */
+        PyCodeObject* kw_code;  /* borrowed, NULL until a keyword call */
+        PyObject* kw_names[JIT_MAX_CACHED_KWARGS];  /* owned */
+        int kw_count;     /* number of keyword arguments */
+        int kw_npos;      /* number of positional arguments, with self */
+        int kw_slots[JIT_MAX_CACHED_KWARGS];  /* parameter of each keyword */
+        int kw_first_unset;  /* first parameter the call leaves unset */
+    } jit_call_cache;
+
+    /* Containers that BINARY_SUBSCR/STORE_SUBSCR sites index inline */
+    enum jit_subscr_kind {
+        JIT_SUBSCR_UNKNOWN = 0,
+        JIT_SUBSCR_LIST_INT,
+        JIT_SUBSCR_TUPLE_INT,
+        JIT_SUBSCR_DICT_STR,
+        JIT_SUBSCR_GENERIC
+    };
+
+    /* Type feedback of a BINARY_SUBSCR/STORE_SUBSCR site: the kind of
+       container indexed there last, whose guard is tried first.  A site
+       that keeps changing kind is left to PyObject_GetItem/SetItem. */
+    typedef struct {
+        int kind;    /* enum jit_subscr_kind */
+        int misses;  /* how often kind changed */
+    } jit_subscr_cache;
+
+    /* Inline cache of a binary operator site: the Python method that
+       implements the operator for instances of a class (Vector.__add__),
+       valid while the class keeps its version tag.  The right operand
+       has the same class or is an int, long or float. */
+    typedef struct {
+        PyTypeObject* type;    /* class of the left operand, or NULL */
+        PyTypeObject* other;   /* type of the right operand */
+        unsigned int version;  /* type->tp_version_tag */
+        PyObject* func;        /* borrowed from the class dict */
+    } jit_binop_cache;
+
+    /* Inline cache of a LOAD_GLOBAL site: the value found for the name,
+       valid while the globals (and the builtins, if the name was found
+       there) keep the ma_version they had when it was looked up. */
+    typedef struct {
+        PyObject* globals;     /* f_globals of the lookup, or NULL */
+        unsigned PY_LONG_LONG globals_version;
+        PyObject* builtins;    /* f_builtins, NULL if found in globals */
+        unsigned PY_LONG_LONG builtins_version;
+        PyObject* value;       /* borrowed from globals or builtins */
+    } jit_global_cache;
+
+    /* Inline cache of a LOAD_ATTR site: a class whose instances keep the
+       attribute in their __dict__, because nothing in the class or its
+       bases defines the name.  Valid while the class keeps its version
+       tag. */
+    typedef struct {
+        PyTypeObject* type;    /* class of the object, or NULL */
+        unsigned int version;  /* type->tp_version_tag */
+    } jit_attr_cache;
+
+    /* A SETUP_LOOP/SETUP_EXCEPT/SETUP_FINALLY block resolved at compile
+       time.  Only the stack level is recorded at run time, in
+       f_blockstack[b_depth].b_level; f_iblock is left alone. */
+    typedef struct {
+        int b_type;     /* what kind of block this is */
+        int b_handler;  /* where to jump to find handler */
+        int b_depth;    /* nesting depth, index into f_blockstack */
+        int b_parent;   /* enclosing block, or -1 */
+        /* A SETUP_EXCEPT whose first clause catches the class named
+           co_names[b_discard_name] and drops the exception, and after
+           which nothing in the frame can look at it before it returns:
+           the offset of the clause body, or -1.  An
+           exception of that class goes straight there, without being
+           normalized, given a traceback or stored in sys.exc_info(). */
+        int b_discard;
+        int b_discard_name;
+    } jit_static_block;
 
     
 #ifdef __cplusplus
@@ -8,6 +8,7 @@
 #include "frameobject.h"
 #include "pythread.h"
 
+#include <stddef.h>
 #include <stdlib.h>
 
 extern volatile int _Py_Ticker;
@@ -25,6 +26,11 @@ typedef struct {
 
     int why;
     PyObject* retval;
+
+    /* for line events of the traced interpreter, as in ceval */
+    int instr_lb;
+    int instr_ub;
+    int instr_prev;
 } interpreter_state;
 
 #define F (st->f)
@@ -54,6 +60,10 @@ init_interpreter_state(interpreter_state* st, PyFrameObject* f, PyThreadState* t
     
     WHY = WHY_NOT;
     RETVAL = 0;
+
+    st->instr_lb = 0;
+    st->instr_ub = -1;
+    st->instr_prev = -1;
 }
 
 #define OPCODE_PREAMBLE \
@@ -93,6 +103,15 @@ init_interpreter_state(interpreter_state* st, PyFrameObject* f, PyThreadState* t
         PERIODIC_CHECKS                                                 \
         /**/
 
+/* A FAT_OPCODE that also gets a pointer to the inline cache of its
+   call site, allocated by the compiler */
+#define CACHED_OPCODE(OPCODENAME, CACHETYPE)                            \
+    __attribute__((used)) static int                                   \
+    opcode_##OPCODENAME (interpreter_state* st, int line, int opcode, int oparg, \
+                         CACHETYPE* cache) {                            \
+        OPCODE_PREAMBLE                                                 \
+        PERIODIC_CHECKS                                                 \
+        /**/
 
 #define END_OPCODE                                                      \
         /* to silent down the warnings */                               \
@@ -173,6 +192,32 @@ void set_lasti(PyFrameObject* f, int lasti) {
     f->f_lasti = lasti;
 }
 
+/* Instruction fetch for the interpreter tier: decode the instruction at
+   *next_instr, folding in an EXTENDED_ARG prefix, and advance *next_instr
+   past it.  Returns the opcode. */
+int fetch_instr(interpreter_state* st, int* next_instr, int* line, int* oparg) {
+    const unsigned char* code = (const unsigned char*) PyString_AS_STRING(CO->co_code);
+    int i = *next_instr;
+    int opcode = code[i];
+    int arg = 0;
+    if (opcode == EXTENDED_ARG) {
+        arg = ((code[i + 2] << 8) + code[i + 1]) << 16;
+        i += 3;
+        opcode = code[i];
+    }
+    *line = i;
+    /* like compiled code, keep f_lasti at the current line for the
+       sampler; BREAK() stores the same value anyway */
+    F->f_lasti = i;
+    if (HAS_ARG(opcode)) {
+        arg += (code[i + 2] << 8) + code[i + 1];
+        i += 2;
+    }
+    *oparg = arg;
+    *next_instr = i + 1;
+    return opcode;
+}
+
 void set_why(interpreter_state* st, int why) {
     WHY = why;
 }
@@ -181,6 +226,22 @@ PyObject* get_retval(interpreter_state* st) {
     return RETVAL;
 }
 
+/* A loop jumps back to target, in the interpreter tier or in code with
+   branch counters once the loop is hot (counted: the code counted the
+   iterations itself).  If the code was compiled or recompiled for the
+   frame, run the rest of the frame there, from the loop header.  The
+   value stack and the blocks are laid out the same in both.  Returns 1
+   with the result of the frame in RETVAL, or 0 to go on here. */
+int loop_back_edge(interpreter_state* st, int target, int counted) {
+    jitted_cfunc_t cfunc = jit_loop_tier_up(F, counted);
+    if (cfunc == NULL)
+        return 0;
+    F->f_stacktop = STACK_POINTER;
+    F->f_lasti = target;
+    RETVAL = cfunc(F, TSTATE, 0);
+    return 1;
+}
+
 extern volatile int things_to_do;
 extern volatile int pendingfirst;
 extern volatile int pendinglast;
@@ -194,6 +255,11 @@ static int do_periodic_things(PyThreadState* tstate) {
 #ifdef WITH_TSC
     ticked = 1;
 #endif
+    if (jit_sample_pending) {
+        jit_sample_pending = 0;
+        if (jit_sample_hook != NULL)
+            jit_sample_hook(tstate);
+    }
     if (things_to_do) {
         if (Py_MakePendingCalls() < 0) {
 //             why = WHY_EXCEPTION;
@@ -338,8 +404,13 @@ OPCODE(RETURN_VALUE) {
     BREAK();
 } END_OPCODE
 
-FAT_OPCODE(PRINT_ITEM) {
-    v = POP();
+/* Shared by PRINT_ITEM and PRINT_ITEM_TO: print v to stream, or to
+   sys.stdout if stream is NULL or None.  Consumes the references to v
+   and stream; returns nonzero with an exception set on error. */
+static int
+print_item(PyObject* v, PyObject* stream) {
+    PyObject* w = stream;
+    int err = 0;
     if (stream == NULL || stream == Py_None) {
         w = PySys_GetObject("stdout");
         if (w == NULL) {
@@ -383,13 +454,14 @@ FAT_OPCODE(PRINT_ITEM) {
     Py_XDECREF(w);
     Py_DECREF(v);
     Py_XDECREF(stream);
-    stream = NULL;
-    if (err == 0)
-        CONTINUE();
-    BREAK();
-} END_OPCODE
+    return err;
+}
 
-FAT_OPCODE(PRINT_NEWLINE) {
+/* Same for PRINT_NEWLINE and PRINT_NEWLINE_TO. */
+static int
+print_newline(PyObject* stream) {
+    PyObject* w = stream;
+    int err = -1;
     if (stream == NULL || stream == Py_None) {
         w = PySys_GetObject("stdout");
         if (w == NULL)
@@ -402,8 +474,39 @@ FAT_OPCODE(PRINT_NEWLINE) {
             PyFile_SoftSpace(w, 0);
     }
     Py_XDECREF(stream);
-    stream = NULL;
-    CONTINUE(); // why is this "break" in ceval.c?
+    return err;
+}
+
+FAT_OPCODE(PRINT_ITEM) {
+    v = POP();
+    err = print_item(v, NULL);
+    if (err == 0)
+        CONTINUE();
+    BREAK();
+} END_OPCODE
+
+FAT_OPCODE(PRINT_ITEM_TO) {
+    stream = POP();
+    v = POP();
+    err = print_item(v, stream);
+    if (err == 0)
+        CONTINUE();
+    BREAK();
+} END_OPCODE
+
+FAT_OPCODE(PRINT_NEWLINE) {
+    err = print_newline(NULL);
+    if (err == 0)
+        CONTINUE();
+    BREAK();
+} END_OPCODE
+
+FAT_OPCODE(PRINT_NEWLINE_TO) {
+    stream = POP();
+    err = print_newline(stream);
+    if (err == 0)
+        CONTINUE();
+    BREAK();
 } END_OPCODE
 
 static PyObject *
@@ -537,6 +640,37 @@ FAT_OPCODE(GET_ITER) {
     BREAK();
 } END_OPCODE
 
+/* GET_ITER of a list comprehension that appends one item per item of
+   the iterable: [list, iterable] are on the stack.  The list is given
+   room for all the items first, when the iterable knows how many. */
+FAT_OPCODE(GET_ITER_PRESIZED) {
+    Py_ssize_t n = -1;
+
+    v = TOP();
+    w = SECOND();
+    if (PyList_CheckExact(w) && PyList_GET_SIZE(w) == 0) {
+        if (PyList_CheckExact(v))
+            n = PyList_GET_SIZE(v);
+        else if (PyTuple_CheckExact(v))
+            n = PyTuple_GET_SIZE(v);
+        else if (PyDict_CheckExact(v))
+            n = PyDict_Size(v);
+        else if (PyRange_Check(v))
+            n = PyObject_Size(v);
+        if (n > 0 && _PyList_Reserve(w, n) < 0) {
+            BREAK();
+        }
+    }
+    x = PyObject_GetIter(v);
+    Py_DECREF(v);
+    if (x != NULL) {
+        SET_TOP(x);
+        CONTINUE();
+    }
+    STACKADJ(-1);
+    BREAK();
+} END_OPCODE
+
 FAT_OPCODE(FOR_ITER) {
     /* before: [iter]; after: [iter, iter()] *or* [] */
     v = TOP();
@@ -565,6 +699,36 @@ FAT_OPCODE(POP_BLOCK) {
     CONTINUE();
 } END_OPCODE
 
+/* BUILD_TUPLE/BUILD_LIST oparg directly followed by UNPACK_SEQUENCE
+   oparg, without the sequence in between: the top oparg values end up
+   in reverse order. */
+OPCODE(REVERSE_STACK) {
+    PyObject** lo = STACK_POINTER - oparg;
+    PyObject** hi = STACK_POINTER - 1;
+    while (lo < hi) {
+        v = *lo;
+        *lo++ = *hi;
+        *hi-- = v;
+    }
+    CONTINUE();
+} END_OPCODE
+
+/* Block handling for code whose block nesting was resolved at compile
+   time: oparg is the depth of the block, see jit_static_block. */
+OPCODE(SETUP_BLOCK_STATIC) {
+    F->f_blockstack[oparg].b_level = STACK_LEVEL();
+    CONTINUE();
+} END_OPCODE
+
+OPCODE(POP_BLOCK_STATIC) {
+    int level = F->f_blockstack[oparg].b_level;
+    while (STACK_LEVEL() > level) {
+        v = POP();
+        Py_DECREF(v);
+    }
+    CONTINUE();
+} END_OPCODE
+
 /* Logic for the raise statement (too complicated for inlining).
    This *consumes* a reference count to each of its arguments. */
 static enum why_code
@@ -760,6 +924,70 @@ call_trace_protected(Py_tracefunc func, PyObject *obj, PyFrameObject *frame,
 	}
 }
 
+static int
+maybe_call_line_trace(Py_tracefunc func, PyObject *obj,
+		      PyFrameObject *frame, int *instr_lb, int *instr_ub,
+		      int *instr_prev)
+{
+	int result = 0;
+
+        /* If the last instruction executed isn't in the current
+           instruction window, reset the window.  If the last
+           instruction happens to fall at the start of a line or if it
+           represents a jump backwards, call the trace function.
+        */
+	if ((frame->f_lasti < *instr_lb || frame->f_lasti >= *instr_ub)) {
+                int line;
+                PyAddrPair bounds;
+
+                line = PyCode_CheckLineNumber(frame->f_code, frame->f_lasti,
+                                              &bounds);
+                if (line >= 0) {
+			frame->f_lineno = line;
+			result = call_trace(func, obj, frame,
+					    PyTrace_LINE, Py_None);
+                }
+                *instr_lb = bounds.ap_lower;
+                *instr_ub = bounds.ap_upper;
+	}
+	else if (frame->f_lasti <= *instr_prev) {
+		result = call_trace(func, obj, frame, PyTrace_LINE, Py_None);
+	}
+	*instr_prev = frame->f_lasti;
+	return result;
+}
+
+/* fetch_instr for the traced interpreter: before the first instruction
+   of a line, and after a jump backwards, the trace function gets a
+   'line' event.  It may set f_lineno, which moves f_lasti: execution
+   goes on there.  Returns 0 (STOP_CODE) with WHY_EXCEPTION if the trace
+   function failed. */
+int fetch_instr_traced(interpreter_state* st, int* next_instr, int* line, int* oparg) {
+    int opcode = fetch_instr(st, next_instr, line, oparg);
+
+    if (TSTATE->c_tracefunc != NULL && !TSTATE->tracing) {
+        int err;
+        /* see maybe_call_line_trace for expository comments; a jump
+           made by the trace function pops the value stack through
+           f_stacktop */
+        F->f_stacktop = STACK_POINTER;
+        err = maybe_call_line_trace(TSTATE->c_tracefunc, TSTATE->c_traceobj, F,
+                                    &st->instr_lb, &st->instr_ub, &st->instr_prev);
+        /* reload possibly changed frame fields */
+        STACK_POINTER = F->f_stacktop;
+        F->f_stacktop = NULL;
+        if (err) {
+            WHY = WHY_EXCEPTION;
+            return 0;
+        }
+        if (F->f_lasti != *line) {
+            *next_instr = F->f_lasti;
+            opcode = fetch_instr(st, next_instr, line, oparg);
+        }
+    }
+    return opcode;
+}
+
 
 static void
 set_exc_info(PyThreadState *tstate,
@@ -807,11 +1035,80 @@ set_exc_info(PyThreadState *tstate,
 }
 
 
-int unwind_stack(interpreter_state* st, int* jump_to) {
+/* Unwind the block b, popping the value stack down to its level.
+   Returns 1 if the block handles the pending WHY, in which case
+   execution continues at *jump_to. */
+static int
+unwind_block(interpreter_state* st, int b_type, int b_handler, int b_level,
+             int* jump_to) {
     PyObject* v;
-    
+
+    assert(WHY != WHY_YIELD);
+    if (b_type == SETUP_LOOP && WHY == WHY_CONTINUE) {
+        WHY = WHY_NOT;
+        *jump_to = PyInt_AS_LONG(RETVAL);
+        Py_DECREF(RETVAL);
+        return 1;
+    }
+
+    while (STACK_LEVEL() > b_level) {
+        v = POP();
+        Py_XDECREF(v);
+    }
+    if (b_type == SETUP_LOOP && WHY == WHY_BREAK) {
+        WHY = WHY_NOT;
+        *jump_to = b_handler;
+        return 1;
+    }
+    if (b_type == SETUP_FINALLY ||
+        (b_type == SETUP_EXCEPT &&
+         WHY == WHY_EXCEPTION)) {
+        if (WHY == WHY_EXCEPTION) {
+            PyObject *exc, *val, *tb;
+            PyErr_Fetch(&exc, &val, &tb);
+            if (val == NULL) {
+                val = Py_None;
+                Py_INCREF(val);
+            }
+            /* Make the raw exception data
+               available to the handler,
+               so a program can emulate the
+               Python main loop.  Don't do
+               this for 'finally'. */
+            if (b_type == SETUP_EXCEPT) {
+                PyErr_NormalizeException(
+                                         &exc, &val, &tb);
+                set_exc_info(TSTATE,
+                             exc, val, tb);
+            }
+            if (tb == NULL) {
+                Py_INCREF(Py_None);
+                PUSH(Py_None);
+            } else
+                PUSH(tb);
+            PUSH(val);
+            PUSH(exc);
+        }
+        else {
+            if (WHY & (WHY_RETURN | WHY_CONTINUE))
+                PUSH(RETVAL);
+            v = PyInt_FromLong((long)WHY);
+            PUSH(v);
+        }
+        WHY = WHY_NOT;
+        *jump_to = b_handler;
+        return 1;
+    }
+    return 0;
+}
+
+/* Common start of unwind_stack and unwind_stack_static; returns 1 if
+   there is nothing to unwind.  traced is a constant: only the traced
+   interpreter reports exceptions to the trace function. */
+static inline int
+begin_unwind(interpreter_state* st, int traced) {
     if (WHY == WHY_YIELD)
-        RETURN(1);
+        return 1;
     
     if (WHY == WHY_NOT) {
         WHY = WHY_EXCEPTION;
@@ -822,98 +1119,189 @@ int unwind_stack(interpreter_state* st, int* jump_to) {
     if (WHY == WHY_EXCEPTION) {
         // XXX this is not under fast_block_end
         PyTraceBack_Here(F);
-        
-//         if (tstate->c_tracefunc != NULL)
-//             call_exc_trace(tstate->c_tracefunc,
-//                            tstate->c_traceobj, f);
+
+        if (traced && TSTATE->c_tracefunc != NULL)
+            call_exc_trace(TSTATE->c_tracefunc,
+                           TSTATE->c_traceobj, F);
     }
 
     if (WHY == WHY_RERAISE)
         WHY = WHY_EXCEPTION;
+    return 0;
+}
+
+/* Common end of unwind_stack and unwind_stack_static, once no block
+   handled the pending WHY: leave the frame. */
+static void
+end_unwind(interpreter_state* st) {
+    PyObject* v;
+
+    assert(WHY != WHY_YIELD);
+    /* Pop remaining stack entries. */
+    while (!EMPTY()) {
+        v = POP();
+        Py_XDECREF(v);
+    }
+
+    if (WHY != WHY_RETURN)
+        RETVAL = NULL;
+}
+
+static inline int
+unwind_blockstack(interpreter_state* st, int* jump_to, int traced) {
+    if (begin_unwind(st, traced))
+        RETURN(1);
     
     // fast_block_end:
     while (WHY != WHY_NOT && F->f_iblock > 0) {
         PyTryBlock *b = PyFrame_BlockPop(F);
 
-        assert(WHY != WHY_YIELD);
         if (b->b_type == SETUP_LOOP && WHY == WHY_CONTINUE) {
             /* For a continue inside a try block,
                don't pop the block for the loop. */
             PyFrame_BlockSetup(F, b->b_type, b->b_handler,
                                b->b_level);
-            WHY = WHY_NOT;
-            *jump_to = PyInt_AS_LONG(RETVAL);
-            Py_DECREF(RETVAL);
-            break;
-        }
-
-        while (STACK_LEVEL() > b->b_level) {
-            v = POP();
-            Py_XDECREF(v);
         }
-        if (b->b_type == SETUP_LOOP && WHY == WHY_BREAK) {
-            WHY = WHY_NOT;
-            *jump_to = b->b_handler;
+        if (unwind_block(st, b->b_type, b->b_handler, b->b_level, jump_to))
             break;
-        }
-        if (b->b_type == SETUP_FINALLY ||
-            (b->b_type == SETUP_EXCEPT &&
-             WHY == WHY_EXCEPTION)) {
-            if (WHY == WHY_EXCEPTION) {
-                PyObject *exc, *val, *tb;
-                PyErr_Fetch(&exc, &val, &tb);
-                if (val == NULL) {
-                    val = Py_None;
-                    Py_INCREF(val);
-                }
-                /* Make the raw exception data
-                   available to the handler,
-                   so a program can emulate the
-                   Python main loop.  Don't do
-                   this for 'finally'. */
-                if (b->b_type == SETUP_EXCEPT) {
-                    PyErr_NormalizeException(
-                                             &exc, &val, &tb);
-                    set_exc_info(TSTATE,
-                                 exc, val, tb);
-                }
-                if (tb == NULL) {
-                    Py_INCREF(Py_None);
-                    PUSH(Py_None);
-                } else
-                    PUSH(tb);
-                PUSH(val);
-                PUSH(exc);
-            }
-            else {
-                if (WHY & (WHY_RETURN | WHY_CONTINUE))
-                    PUSH(RETVAL);
-                v = PyInt_FromLong((long)WHY);
-                PUSH(v);
-            }
-            WHY = WHY_NOT;
-            *jump_to = b->b_handler;
-            break;
-        }
     } /* unwind stack */
     
     if (WHY == WHY_NOT) {
         CONTINUE();
     }
 
-    assert(WHY != WHY_YIELD);
-    /* Pop remaining stack entries. */
-    while (!EMPTY()) {
+    end_unwind(st);
+    RETURN(1);
+}
+
+int unwind_stack(interpreter_state* st, int* jump_to) {
+    return unwind_blockstack(st, jump_to, 0);
+}
+
+int unwind_stack_traced(interpreter_state* st, int* jump_to) {
+    return unwind_blockstack(st, jump_to, 1);
+}
+
+/* An exception raised inside a try statement whose except clause
+   drops it (see jit_static_block) jumps to the clause body once it is
+   known to match.  Returns 0 if the regular unwinding has to run. */
+static inline int
+discard_exception(interpreter_state* st, int* jump_to,
+                  const jit_static_block* blocks, const int* block_at) {
+    const jit_static_block* b;
+    PyObject *name, *cls, *v;
+    int i, level;
+
+    if (WHY != WHY_NOT && WHY != WHY_EXCEPTION)
+        return 0;
+    /* loops only pop the stack on the way */
+    for (i = block_at[F->f_lasti]; i >= 0 && blocks[i].b_type == SETUP_LOOP;
+         i = blocks[i].b_parent)
+        ;
+    if (i < 0 || blocks[i].b_discard < 0 || !PyErr_Occurred())
+        return 0;
+    b = &blocks[i];
+    name = GETITEM(NAMES, b->b_discard_name);
+    cls = PyDict_GetItem(F->f_globals, name);
+    if (cls == NULL)
+        cls = PyDict_GetItem(F->f_builtins, name);
+    if (cls == NULL || !PyExceptionClass_Check(cls) ||
+        !PyErr_ExceptionMatches(cls))
+        return 0;
+
+    PyErr_Clear();
+    level = F->f_blockstack[b->b_depth].b_level;
+    while (STACK_LEVEL() > level) {
         v = POP();
         Py_XDECREF(v);
     }
+    WHY = WHY_NOT;
+    *jump_to = b->b_discard;
+    return 1;
+}
 
-    if (WHY != WHY_RETURN)
-        RETVAL = NULL;
+/* unwind_stack for code compiled with static block resolution: the
+   enclosing blocks of the instruction at f_lasti are found in the
+   compile-time tables instead of f_blockstack. */
+int unwind_stack_static(interpreter_state* st, int* jump_to,
+                        const jit_static_block* blocks, const int* block_at) {
+    const jit_static_block* b;
+    int i;
+
+    if (discard_exception(st, jump_to, blocks, block_at))
+        CONTINUE();
+    if (begin_unwind(st, 0))
+        RETURN(1);
+
+    for (i = block_at[F->f_lasti]; WHY != WHY_NOT && i >= 0; i = b->b_parent) {
+        b = &blocks[i];
+        if (unwind_block(st, b->b_type, b->b_handler,
+                         F->f_blockstack[b->b_depth].b_level, jump_to))
+            break;
+    }
 
+    if (WHY == WHY_NOT) {
+        CONTINUE();
+    }
+
+    end_unwind(st);
     RETURN(1);
 }
 
+FAT_OPCODE(WITH_CLEANUP) {
+    /* TOP is the context.__exit__ bound method.
+       Below that are 1-3 values indicating how/why
+       we entered the finally clause:
+       - SECOND = None
+       - (SECOND, THIRD) = (WHY_{RETURN,CONTINUE}), retval
+       - SECOND = WHY_*; no retval below it
+       - (SECOND, THIRD, FOURTH) = exc_info()
+       In the last case, we must call
+         TOP(SECOND, THIRD, FOURTH)
+       otherwise we must call
+         TOP(None, None, None)
+
+       In addition, if the stack represents an exception,
+       *and* the function call returns a 'true' value, we
+       "zap" this information, to prevent END_FINALLY from
+       re-raising the exception.  (But non-local gotos
+       should still be resumed.)
+    */
+    x = TOP();
+    u = SECOND();
+    if (PyInt_Check(u) || u == Py_None) {
+        u = v = w = Py_None;
+    }
+    else {
+        v = THIRD();
+        w = FOURTH();
+    }
+    /* XXX Not the fastest way to call it... */
+    x = PyObject_CallFunctionObjArgs(x, u, v, w, NULL);
+    if (x == NULL)
+        BREAK(); /* Go to error exit */
+    if (u != Py_None && (err = PyObject_IsTrue(x)) != 0) {
+        Py_DECREF(x);
+        if (err < 0)
+            BREAK();
+        /* There was an exception and a true return */
+        x = TOP(); /* Again */
+        STACKADJ(-3);
+        Py_INCREF(Py_None);
+        SET_TOP(Py_None);
+        Py_DECREF(x);
+        Py_DECREF(u);
+        Py_DECREF(v);
+        Py_DECREF(w);
+    } else {
+        /* Let END_FINALLY do its thing */
+        Py_DECREF(x);
+        x = POP();
+        Py_DECREF(x);
+    }
+    CONTINUE();
+} END_OPCODE
+
 FAT_OPCODE(END_FINALLY) {
     v = POP();
     if (PyInt_Check(v)) {
@@ -1297,7 +1685,13 @@ ext_do_call(PyObject *func, PyObject ***pp_stack, int flags, int na, int nk)
 		if (kwdict == NULL)
 			goto ext_call_fail;
 	}
-	callargs = update_star_args(na, nstar, stararg, pp_stack);
+	if (na == 0 && stararg != NULL && PyTuple_CheckExact(stararg)) {
+		/* f(*args): tuples are immutable, pass args on as it is */
+		callargs = stararg;
+		Py_INCREF(callargs);
+	}
+	else
+		callargs = update_star_args(na, nstar, stararg, pp_stack);
 	if (callargs == NULL)
 		goto ext_call_fail;
 #ifdef CALL_PROFILE
@@ -1332,6 +1726,303 @@ FAT_OPCODE(CALL_FUNCTION) {
     
 } END_OPCODE
 
+/* Recognize the builtins that cached call sites expand inline, by their
+   PyMethodDef in the method table of the __builtin__ module.  The table
+   is searched by name, so what the names in the builtins are bound to
+   doesn't matter. */
+static int
+intrinsic_for(PyMethodDef* ml) {
+    static const struct {
+        const char* name;
+        int intrinsic;
+    } intrinsics[] = {
+        {"len", JIT_INTRINSIC_LEN},
+        {"isinstance", JIT_INTRINSIC_ISINSTANCE},
+        {"abs", JIT_INTRINSIC_ABS},
+        {NULL, JIT_INTRINSIC_NONE}
+    };
+    static PyMethodDef* defs[sizeof(intrinsics) / sizeof(intrinsics[0])];
+    static int resolved = 0;
+    int i;
+
+    if (!resolved) {
+        for (i = 0; intrinsics[i].name != NULL; i++)
+            defs[i] = _PyBuiltin_FindMethod(intrinsics[i].name);
+        resolved = 1;
+    }
+    for (i = 0; intrinsics[i].name != NULL; i++)
+        if (defs[i] == ml)
+            return intrinsics[i].intrinsic;
+    return JIT_INTRINSIC_NONE;
+}
+
+static PyObject*
+call_intrinsic(int intrinsic, PyObject** args, int na) {
+    PyObject* v = args[0];
+    Py_ssize_t n;
+    long a;
+
+    switch (intrinsic) {
+    case JIT_INTRINSIC_LEN:
+        if (PyList_CheckExact(v))
+            n = PyList_GET_SIZE(v);
+        else if (PyTuple_CheckExact(v))
+            n = PyTuple_GET_SIZE(v);
+        else if (PyString_CheckExact(v))
+            n = PyString_GET_SIZE(v);
+        else if (PyDict_CheckExact(v))
+            n = ((PyDictObject*)v)->ma_used;
+        else {
+            n = PyObject_Size(v);
+            if (n < 0 && PyErr_Occurred())
+                return NULL;
+        }
+        return PyInt_FromSsize_t(n);
+    case JIT_INTRINSIC_ISINSTANCE:
+        if ((PyObject*)v->ob_type == args[1]) {
+            Py_INCREF(Py_True);
+            return Py_True;
+        }
+        n = PyObject_IsInstance(v, args[1]);
+        if (n < 0)
+            return NULL;
+        return PyBool_FromLong(n);
+    case JIT_INTRINSIC_ABS:
+        if (PyInt_CheckExact(v) && (a = PyInt_AS_LONG(v)) >= 0) {
+            Py_INCREF(v);
+            return v;
+        }
+        return PyNumber_Absolute(v);
+    }
+    assert(0);
+    return NULL;
+}
+
+/* Code whose frame the cache can set up: only positional parameters, no
+   cells, not a generator.  Future statements and nesting don't matter. */
+#define KW_CACHEABLE(co) \
+    (((co)->co_flags & ~(PyCF_MASK | CO_NESTED)) == \
+     (CO_OPTIMIZED | CO_NEWLOCALS | CO_NOFREE))
+
+/* Match the nk keywords at kws (name, value pairs on the stack) against
+   the parameters of co for a call with npos positional arguments, and
+   remember the result in cache.  Returns 0 if the call can't be bound
+   from the cache, for the generic path to handle it or raise. */
+static int
+fill_kw_cache(jit_call_cache* cache, PyCodeObject* co, int npos,
+              PyObject** kws, int nk) {
+    PyObject* w;
+    int i, j, k;
+
+    cache->kw_code = NULL;
+    for (k = 0; k < cache->kw_count; k++)
+        Py_CLEAR(cache->kw_names[k]);
+    cache->kw_count = 0;
+    if (!KW_CACHEABLE(co) || npos + nk > co->co_argcount)
+        return 0;
+    for (k = 0; k < nk; k++) {
+        w = kws[2 * k];
+        if (!PyString_CheckExact(w))
+            return 0;
+        for (j = npos; j < co->co_argcount; j++)
+            if (_PyString_Eq(w, PyTuple_GET_ITEM(co->co_varnames, j)))
+                break;
+        if (j == co->co_argcount)
+            return 0;
+        for (i = 0; i < k; i++)
+            if (cache->kw_slots[i] == j)
+                return 0;
+        cache->kw_slots[k] = j;
+    }
+    for (j = npos; j < co->co_argcount; j++) {
+        for (k = 0; k < nk; k++)
+            if (cache->kw_slots[k] == j)
+                break;
+        if (k == nk)
+            break;
+    }
+    cache->kw_first_unset = j;
+    for (k = 0; k < nk; k++) {
+        Py_INCREF(kws[2 * k]);
+        cache->kw_names[k] = kws[2 * k];
+    }
+    cache->kw_code = co;
+    cache->kw_count = nk;
+    cache->kw_npos = npos;
+    return 1;
+}
+
+/* f(a, b=x) of a Python function (or a method bound to one): the
+   arguments are stored straight into the parameters of the new frame
+   that the cache maps the keywords to, instead of going through the
+   keyword matching in PyEval_EvalCodeEx.  pfunc points to the function
+   on the stack, followed by na arguments and nk keyword pairs.  Returns
+   0 if the generic path has to make the call. */
+static int
+call_function_kw_cached(jit_call_cache* cache, PyObject** pfunc, int na,
+                        int nk, PyObject** result) {
+    PyObject* func = *pfunc;
+    PyObject* self = NULL;
+    PyObject** kws = pfunc + 1 + na;
+    PyObject* w;
+    PyCodeObject* co;
+    PyObject* argdefs;
+    PyFrameObject* f;
+    PyObject** fastlocals;
+    PyThreadState* tstate;
+    int npos, ndefs, i, k;
+
+    if (nk > JIT_MAX_CACHED_KWARGS)
+        return 0;
+    if (PyMethod_Check(func) && PyMethod_GET_SELF(func) != NULL) {
+        self = PyMethod_GET_SELF(func);
+        func = PyMethod_GET_FUNCTION(func);
+    }
+    if (!PyFunction_Check(func))
+        return 0;
+    co = (PyCodeObject*)PyFunction_GET_CODE(func);
+    npos = na + (self != NULL);
+    k = 0;
+    /* kw_code is borrowed, and may have been freed and its memory reused
+       by another code object: the keywords must still name the
+       parameters the cache binds them to */
+    if (co == cache->kw_code && npos == cache->kw_npos &&
+        nk == cache->kw_count && KW_CACHEABLE(co) &&
+        npos + nk <= co->co_argcount)
+        while (k < nk && kws[2 * k] == cache->kw_names[k] &&
+               cache->kw_slots[k] < co->co_argcount &&
+               PyTuple_GET_ITEM(co->co_varnames, cache->kw_slots[k]) ==
+               kws[2 * k])
+            k++;
+    if (k < nk || cache->kw_code == NULL) {
+        if (!fill_kw_cache(cache, co, npos, kws, nk))
+            return 0;
+    }
+    argdefs = PyFunction_GET_DEFAULTS(func);
+    ndefs = argdefs != NULL ? PyTuple_GET_SIZE(argdefs) : 0;
+    if (cache->kw_first_unset < co->co_argcount - ndefs)
+        return 0; /* a parameter without a default is left unset */
+
+    tstate = PyThreadState_GET();
+    f = PyFrame_New(tstate, co, PyFunction_GET_GLOBALS(func), NULL);
+    if (f == NULL) {
+        *result = NULL;
+        return 1;
+    }
+    fastlocals = f->f_localsplus;
+    i = 0;
+    if (self != NULL) {
+        Py_INCREF(self);
+        fastlocals[i++] = self;
+    }
+    for (k = 0; k < na; k++) {
+        Py_INCREF(pfunc[1 + k]);
+        fastlocals[i++] = pfunc[1 + k];
+    }
+    for (k = 0; k < nk; k++) {
+        Py_INCREF(kws[2 * k + 1]);
+        fastlocals[cache->kw_slots[k]] = kws[2 * k + 1];
+    }
+    for (i = cache->kw_first_unset; i < co->co_argcount; i++) {
+        if (fastlocals[i] == NULL) {
+            w = PyTuple_GET_ITEM(argdefs, i - (co->co_argcount - ndefs));
+            Py_INCREF(w);
+            fastlocals[i] = w;
+        }
+    }
+    *result = PyEval_EvalFrameEx(f, 0);
+    ++tstate->recursion_depth;
+    Py_DECREF(f);
+    --tstate->recursion_depth;
+    return 1;
+}
+
+/* CALL_FUNCTION at a site with an inline cache.  While the callee is the
+   builtin in the cache, the call goes straight to its ml_meth without
+   the dispatch in call_function (or is expanded inline for the builtins
+   in enum jit_intrinsic); anything else takes the generic path and
+   refills the cache.  type(x) is always expanded inline.  Keyword calls
+   of Python functions are bound by call_function_kw_cached. */
+CACHED_OPCODE(CALL_FUNCTION_CACHED, jit_call_cache) {
+    int na = oparg;
+    PyObject** pfunc;
+    PyCFunctionObject* func;
+    int flags;
+
+    if (TSTATE->use_tracing)
+        goto generic; /* C calls are profiled */
+    if (oparg > 0xff) {
+        na = oparg & 0xff;
+        pfunc = STACK_POINTER - na - 2 * (oparg >> 8) - 1;
+        if (call_function_kw_cached(cache, pfunc, na, oparg >> 8, &x))
+            goto done;
+        goto generic;
+    }
+    pfunc = STACK_POINTER - na - 1;
+    v = *pfunc;
+    if (v == (PyObject*)&PyType_Type && na == 1) {
+        x = (PyObject*)TOP()->ob_type;
+        Py_INCREF(x);
+        goto done;
+    }
+    if (!PyCFunction_Check(v))
+        goto generic;
+    func = (PyCFunctionObject*)v;
+    if (func->m_ml != cache->ml) {
+        cache->ml = func->m_ml;
+        cache->intrinsic = intrinsic_for(func->m_ml);
+    }
+
+    flags = cache->ml->ml_flags & ~(METH_CLASS | METH_STATIC | METH_COEXIST);
+    switch (cache->intrinsic) {
+    case JIT_INTRINSIC_LEN:
+    case JIT_INTRINSIC_ABS:
+        if (na != 1)
+            goto generic;
+        x = call_intrinsic(cache->intrinsic, pfunc + 1, na);
+        goto done;
+    case JIT_INTRINSIC_ISINSTANCE:
+        if (na != 2)
+            goto generic;
+        x = call_intrinsic(cache->intrinsic, pfunc + 1, na);
+        goto done;
+    }
+    if (flags == METH_NOARGS && na == 0)
+        x = (*cache->ml->ml_meth)(func->m_self, NULL);
+    else if (flags == METH_O && na == 1)
+        x = (*cache->ml->ml_meth)(func->m_self, TOP());
+    else if (flags == METH_VARARGS ||
+             flags == (METH_VARARGS | METH_KEYWORDS)) {
+        w = load_args(&STACK_POINTER, na);
+        if (w == NULL)
+            x = NULL;
+        else if (flags & METH_KEYWORDS)
+            x = (*(PyCFunctionWithKeywords)cache->ml->ml_meth)(func->m_self, w, NULL);
+        else
+            x = (*cache->ml->ml_meth)(func->m_self, w);
+        Py_XDECREF(w);
+    }
+    else
+        goto generic; /* wrong number of arguments, METH_OLDARGS */
+
+  done:
+    while (STACK_POINTER > pfunc) {
+        w = POP();
+        Py_DECREF(w);
+    }
+    PUSH(x);
+    if (x != NULL)
+        CONTINUE();
+    BREAK();
+
+  generic:
+    x = call_function(&(STACK_POINTER), oparg);
+    PUSH(x);
+    if (x != NULL)
+        CONTINUE();
+    BREAK();
+} END_OPCODE
+
 FAT_OPCODE(MAKE_FUNCTION) {
     v = POP(); /* code object */
     x = PyFunction_New(v, F->f_globals);
@@ -1392,6 +2083,109 @@ FAT_OPCODE(LOAD_ATTR) {
     BREAK();
 } END_OPCODE
 
+/* obj.meth(args) is compiled to LOAD_METHOD meth, args, CALL_METHOD n.
+   When meth is a method, LOAD_METHOD leaves [meth, obj] on the stack
+   and CALL_METHOD calls meth with n + 1 arguments, so that no bound
+   method is created.  Otherwise it leaves [NULL, obj.meth] and
+   CALL_METHOD is a plain call. */
+FAT_OPCODE(LOAD_METHOD) {
+    w = GETITEM(NAMES, oparg);
+    v = TOP();
+    if (_PyObject_GetMethod(v, w, &x)) {
+        SET_TOP(x);
+        PUSH(v);
+        CONTINUE();
+    }
+    Py_DECREF(v);
+    if (x == NULL) {
+        SET_TOP(NULL);
+        BREAK();
+    }
+    SET_TOP(NULL);
+    PUSH(x);
+    CONTINUE();
+} END_OPCODE
+
+/* Call the method descriptor d (list.append, say) on the na objects at
+   args, self and the arguments, straight through its PyMethodDef: no
+   bound builtin method and argument tuple slice are created, unlike in
+   methoddescr_call.  Returns 0 if d has to be called the regular way. */
+static int
+call_method_descr(PyMethodDescrObject* d, PyObject** args, int na,
+                  PyObject** result) {
+    PyCFunction meth = d->d_method->ml_meth;
+    int flags = d->d_method->ml_flags & ~(METH_CLASS | METH_STATIC | METH_COEXIST);
+    PyObject* callargs;
+    int i;
+
+    if (!PyObject_TypeCheck(args[0], d->d_type))
+        return 0;
+    if (flags == METH_NOARGS && na == 1)
+        *result = (*meth)(args[0], NULL);
+    else if (flags == METH_O && na == 2)
+        *result = (*meth)(args[0], args[1]);
+    else if (flags == METH_VARARGS ||
+             flags == (METH_VARARGS | METH_KEYWORDS)) {
+        callargs = PyTuple_New(na - 1);
+        if (callargs == NULL) {
+            *result = NULL;
+            return 1;
+        }
+        for (i = 1; i < na; i++) {
+            Py_INCREF(args[i]);
+            PyTuple_SET_ITEM(callargs, i - 1, args[i]);
+        }
+        if (flags & METH_KEYWORDS)
+            *result = (*(PyCFunctionWithKeywords)meth)(args[0], callargs, NULL);
+        else
+            *result = (*meth)(args[0], callargs);
+        Py_DECREF(callargs);
+    }
+    else
+        return 0;
+    return 1;
+}
+
+FAT_OPCODE(CALL_METHOD) {
+    PyObject** pmeth = STACK_POINTER - oparg - 2;
+    if (*pmeth != NULL && PyMethodDescr_Check(*pmeth) && TSTATE->use_tracing) {
+        /* Bind the method, as LOAD_ATTR would have, so that call_function
+           reports the call of the builtin method to the profiler */
+        v = *pmeth;
+        x = v->ob_type->tp_descr_get(v, pmeth[1], (PyObject*)pmeth[1]->ob_type);
+        if (x == NULL) {
+            while (STACK_POINTER > pmeth) {
+                w = POP();
+                Py_DECREF(w);
+            }
+            PUSH(x);
+            BREAK();
+        }
+        Py_DECREF(pmeth[1]);
+        pmeth[1] = x;
+        *pmeth = NULL;
+        Py_DECREF(v);
+    }
+    if (*pmeth == NULL) {
+        x = call_function(&(STACK_POINTER), oparg);
+        STACKADJ(-1);
+    }
+    else if (PyMethodDescr_Check(*pmeth) &&
+             call_method_descr((PyMethodDescrObject*)*pmeth, pmeth + 1,
+                               oparg + 1, &x)) {
+        while (STACK_POINTER > pmeth) {
+            w = POP();
+            Py_DECREF(w);
+        }
+    }
+    else
+        x = call_function(&(STACK_POINTER), oparg + 1);
+    PUSH(x);
+    if (x != NULL)
+        CONTINUE();
+    BREAK();
+} END_OPCODE
+
 FAT_OPCODE(STORE_ATTR) {
     w = GETITEM(NAMES, oparg);
     v = TOP();
@@ -1934,6 +2728,16 @@ FAT_OPCODE(LOAD_GLOBAL) {
     CONTINUE();
 } END_OPCODE
 
+FAT_OPCODE(DELETE_GLOBAL) {
+    w = GETITEM(NAMES, oparg);
+    if ((err = PyDict_DelItem(F->f_globals, w)) != 0) {
+        format_exc_check_arg(PyExc_NameError,
+                             GLOBAL_NAME_ERROR_MSG, w);
+        BREAK();
+    }
+    CONTINUE();
+} END_OPCODE
+
 FAT_OPCODE(STORE_GLOBAL) {
     w = GETITEM(NAMES, oparg);
     v = POP();
@@ -1982,6 +2786,293 @@ FAT_OPCODE(STORE_SUBSCR) {
     BREAK();
 } END_OPCODE
 
+/* Changes of kind after which a subscript site stays generic */
+#define SUBSCR_MAX_MISSES 16
+
+static inline int
+subscr_kind(PyObject* v, PyObject* w) {
+    if (PyInt_CheckExact(w)) {
+        if (PyList_CheckExact(v))
+            return JIT_SUBSCR_LIST_INT;
+        if (PyTuple_CheckExact(v))
+            return JIT_SUBSCR_TUPLE_INT;
+    }
+    else if (PyString_CheckExact(w) && PyDict_CheckExact(v))
+        return JIT_SUBSCR_DICT_STR;
+    return JIT_SUBSCR_GENERIC;
+}
+
+/* Guard of the path tried first at the site, falling back to the kind
+   of v[w] when it fails; the feedback in cache is updated on the way. */
+static inline int
+subscr_feedback(jit_subscr_cache* cache, PyObject* v, PyObject* w) {
+    int kind = cache->kind;
+    switch (kind) {
+    case JIT_SUBSCR_LIST_INT:
+        if (PyList_CheckExact(v) && PyInt_CheckExact(w))
+            return kind;
+        break;
+    case JIT_SUBSCR_TUPLE_INT:
+        if (PyTuple_CheckExact(v) && PyInt_CheckExact(w))
+            return kind;
+        break;
+    case JIT_SUBSCR_DICT_STR:
+        if (PyDict_CheckExact(v) && PyString_CheckExact(w))
+            return kind;
+        break;
+    case JIT_SUBSCR_GENERIC:
+        if (cache->misses > SUBSCR_MAX_MISSES)
+            return kind;
+        break;
+    }
+    kind = subscr_kind(v, w);
+    if (cache->kind != JIT_SUBSCR_UNKNOWN)
+        ++cache->misses;
+    cache->kind = kind;
+    return kind;
+}
+
+/* Index i of a sequence of size n, or -1 if it is out of bounds */
+static inline Py_ssize_t
+subscr_index(PyObject* w, Py_ssize_t n) {
+    Py_ssize_t i = PyInt_AS_LONG(w);
+    if (i < 0)
+        i += n;
+    if ((size_t)i >= (size_t)n)
+        return -1;
+    return i;
+}
+
+/* The entry of the exact dict v for the exact string w, looked up with
+   the cached hash of w, or NULL with an exception set. */
+static inline PyDictEntry*
+subscr_dict_entry(PyObject* v, PyObject* w) {
+    long hash = ((PyStringObject*)w)->ob_shash;
+    if (hash == -1) {
+        hash = PyObject_Hash(w);
+        if (hash == -1)
+            return NULL;
+    }
+    return ((PyDictObject*)v)->ma_lookup((PyDictObject*)v, w, hash);
+}
+
+/* BINARY_SUBSCR at a site with type feedback.  list[int], tuple[int]
+   and dict[str] are looked up inline; misses (an index out of range, a
+   missing key) and other containers go through PyObject_GetItem, which
+   raises the error. */
+CACHED_OPCODE(BINARY_SUBSCR_CACHED, jit_subscr_cache) {
+    Py_ssize_t i;
+    PyDictEntry* ep;
+
+    w = POP();
+    v = TOP();
+    switch (subscr_feedback(cache, v, w)) {
+    case JIT_SUBSCR_LIST_INT:
+        i = subscr_index(w, PyList_GET_SIZE(v));
+        if (i < 0)
+            goto generic;
+        x = PyList_GET_ITEM(v, i);
+        Py_INCREF(x);
+        break;
+    case JIT_SUBSCR_TUPLE_INT:
+        i = subscr_index(w, PyTuple_GET_SIZE(v));
+        if (i < 0)
+            goto generic;
+        x = PyTuple_GET_ITEM(v, i);
+        Py_INCREF(x);
+        break;
+    case JIT_SUBSCR_DICT_STR:
+        ep = subscr_dict_entry(v, w);
+        if (ep == NULL) {
+            x = NULL;
+            break;
+        }
+        x = ep->me_value;
+        if (x == NULL)
+            goto generic;
+        Py_INCREF(x);
+        break;
+    default:
+    generic:
+        x = PyObject_GetItem(v, w);
+    }
+    Py_DECREF(v);
+    Py_DECREF(w);
+    SET_TOP(x);
+    if (x != NULL) CONTINUE();
+    BREAK();
+} END_OPCODE
+
+/* STORE_SUBSCR at a site with type feedback: an item of a list is
+   replaced in place and a dict is stored to without the mapping
+   protocol dispatch. */
+CACHED_OPCODE(STORE_SUBSCR_CACHED, jit_subscr_cache) {
+    Py_ssize_t i;
+
+    w = TOP();
+    v = SECOND();
+    u = THIRD();
+    STACKADJ(-3);
+    /* v[w] = u */
+    switch (subscr_feedback(cache, v, w)) {
+    case JIT_SUBSCR_LIST_INT:
+        i = subscr_index(w, PyList_GET_SIZE(v));
+        if (i < 0)
+            goto generic;
+        x = PyList_GET_ITEM(v, i);
+        PyList_SET_ITEM(v, i, u);
+        Py_DECREF(x);
+        err = 0;
+        break;
+    case JIT_SUBSCR_DICT_STR:
+        err = PyDict_SetItem(v, w, u);
+        Py_DECREF(u);
+        break;
+    default:
+    generic:
+        err = PyObject_SetItem(v, w, u);
+        Py_DECREF(u);
+    }
+    Py_DECREF(v);
+    Py_DECREF(w);
+    if (err == 0) CONTINUE();
+    BREAK();
+} END_OPCODE
+
+/* Look up a global the way LOAD_GLOBAL does and remember where it was
+   found.  The versions are read before the lookups: a lookup that runs
+   __eq__ and changes a dict leaves a cache that misses next time.
+   Returns the value (borrowed), or NULL if the name is not bound or an
+   exception is set. */
+static PyObject*
+fill_global_cache(jit_global_cache* cache, PyObject* globals,
+                  PyObject* builtins, PyObject* name) {
+    unsigned PY_LONG_LONG globals_version = ((PyDictObject*)globals)->ma_version;
+    unsigned PY_LONG_LONG builtins_version = ((PyDictObject*)builtins)->ma_version;
+    PyDictEntry* ep;
+
+    cache->globals = NULL;
+    ep = subscr_dict_entry(globals, name);
+    if (ep == NULL)
+        return NULL;
+    if (ep->me_value != NULL) {
+        cache->builtins = NULL;
+    } else {
+        ep = subscr_dict_entry(builtins, name);
+        if (ep == NULL || ep->me_value == NULL)
+            return NULL;
+        cache->builtins = builtins;
+        cache->builtins_version = builtins_version;
+    }
+    cache->globals = globals;
+    cache->globals_version = globals_version;
+    cache->value = ep->me_value;
+    return ep->me_value;
+}
+
+/* LOAD_GLOBAL at a site with an inline cache: while neither the
+   globals nor the builtins the name was found in have changed, the
+   value found last time is loaded without a dict lookup.  A global
+   loaded in a loop is thus looked up once, unless the loop stores to
+   some global. */
+CACHED_OPCODE(LOAD_GLOBAL_CACHED, jit_global_cache) {
+    PyObject* globals = F->f_globals;
+    PyObject* builtins = F->f_builtins;
+
+    if (cache->globals == globals &&
+        cache->globals_version == ((PyDictObject*)globals)->ma_version &&
+        (cache->builtins == NULL ||
+         (cache->builtins == builtins &&
+          cache->builtins_version == ((PyDictObject*)builtins)->ma_version))) {
+        x = cache->value;
+        Py_INCREF(x);
+        PUSH(x);
+        CONTINUE();
+    }
+    w = GETITEM(NAMES, oparg);
+    if (PyString_CheckExact(w) && PyDict_Check(globals) && PyDict_Check(builtins)) {
+        x = fill_global_cache(cache, globals, builtins, w);
+        if (x == NULL && PyErr_Occurred())
+            BREAK();
+    } else {
+        x = PyDict_GetItem(globals, w);
+        if (x == NULL)
+            x = PyDict_GetItem(builtins, w);
+    }
+    if (x == NULL) {
+        format_exc_check_arg(PyExc_NameError, GLOBAL_NAME_ERROR_MSG, w);
+        BREAK();
+    }
+    Py_INCREF(x);
+    PUSH(x);
+    CONTINUE();
+} END_OPCODE
+
+/* Remember type for a LOAD_ATTR site if PyObject_GenericGetAttr() finds
+   the attribute name of its instances in their __dict__ or nowhere:
+   when the class and its bases define nothing by that name. */
+static void
+fill_attr_cache(jit_attr_cache* cache, PyTypeObject* type, PyObject* name) {
+    cache->type = NULL;
+    if (type->tp_getattro != PyObject_GenericGetAttr ||
+        type->tp_dictoffset <= 0 || !PyString_CheckExact(name))
+        return;
+    if (!_PyType_AssignVersionTag(type))
+        return;
+    if (_PyType_Lookup(type, name) != NULL)
+        return;
+    cache->type = type;
+    cache->version = type->tp_version_tag;
+}
+
+/* LOAD_ATTR at a site with an inline cache.  An attribute of an
+   instance is looked up in its __dict__ alone: for classic instances
+   that is what instance_getattr() tries first anyway, for instances of
+   classes the cache tells that no descriptor of the class gets in the
+   way.  Everything else, and attributes missing from the __dict__, go
+   through PyObject_GetAttr(). */
+CACHED_OPCODE(LOAD_ATTR_CACHED, jit_attr_cache) {
+    PyTypeObject* tp;
+    PyDictEntry* ep;
+
+    w = GETITEM(NAMES, oparg);
+    v = TOP();
+    tp = v->ob_type;
+    u = NULL;
+    if (PyInstance_Check(v)) {
+        /* __dict__ and __class__ are special */
+        if (PyString_CheckExact(w)) {
+            const char* s = PyString_AS_STRING(w);
+            if (!(s[0] == '_' && s[1] == '_'))
+                u = ((PyInstanceObject*)v)->in_dict;
+        }
+    } else {
+        if (tp != cache->type ||
+            !(tp->tp_flags & Py_TPFLAGS_VALID_VERSION_TAG) ||
+            tp->tp_version_tag != cache->version)
+            fill_attr_cache(cache, tp, w);
+        if (cache->type == tp)
+            u = *(PyObject**)((char*)v + tp->tp_dictoffset);
+    }
+    if (u != NULL && PyDict_Check(u)) {
+        ep = subscr_dict_entry(u, w);
+        if (ep == NULL)
+            BREAK();
+        x = ep->me_value;
+        if (x != NULL) {
+            Py_INCREF(x);
+            Py_DECREF(v);
+            SET_TOP(x);
+            CONTINUE();
+        }
+    }
+    x = PyObject_GetAttr(v, w);
+    Py_DECREF(v);
+    SET_TOP(x);
+    if (x != NULL) CONTINUE();
+    BREAK();
+} END_OPCODE
+
 FAT_OPCODE(DELETE_SUBSCR) {
     w = TOP();
     v = SECOND();
@@ -1997,6 +3088,14 @@ FAT_OPCODE(DELETE_SUBSCR) {
 FAT_OPCODE(LIST_APPEND) {
     w = POP();
     v = POP();
+    if (PyList_CheckExact(v) &&
+        PyList_GET_SIZE(v) < ((PyListObject*)v)->allocated) {
+        /* room left, by GET_ITER_PRESIZED or an earlier resize */
+        PyList_SET_ITEM(v, PyList_GET_SIZE(v), w);
+        ((PyListObject*)v)->ob_size++;
+        Py_DECREF(v);
+        CONTINUE();
+    }
     err = PyList_Append(v, w);
     Py_DECREF(v);
     Py_DECREF(w);
@@ -2094,6 +3193,122 @@ FAT_OPCODE(UNARY_INVERT) {
     BREAK();
 } END_OPCODE
 
+/* The binary operators with inline caches */
+static struct binop_method {
+    int opcode;
+    const char* name;     /* the special method */
+    const char* symbol;   /* for the error message */
+    Py_ssize_t slot;      /* offset in PyNumberMethods */
+    PyObject* name_str;   /* interned name */
+} binop_methods[] = {
+    {BINARY_ADD, "__add__", "+", offsetof(PyNumberMethods, nb_add)},
+    {BINARY_SUBTRACT, "__sub__", "-", offsetof(PyNumberMethods, nb_subtract)},
+    {BINARY_MULTIPLY, "__mul__", "*", offsetof(PyNumberMethods, nb_multiply)},
+    {BINARY_DIVIDE, "__div__", "/", offsetof(PyNumberMethods, nb_divide)},
+    {BINARY_TRUE_DIVIDE, "__truediv__", "/", offsetof(PyNumberMethods, nb_true_divide)},
+    {BINARY_FLOOR_DIVIDE, "__floordiv__", "//", offsetof(PyNumberMethods, nb_floor_divide)},
+    {BINARY_MODULO, "__mod__", "%", offsetof(PyNumberMethods, nb_remainder)},
+    {0}
+};
+
+#define NB_BINOP(nb_methods, slot) \
+    (*(binaryfunc*)(& ((char*)nb_methods)[slot]))
+
+static inline struct binop_method*
+binop_method_for(int opcode) {
+    struct binop_method* op = binop_methods;
+    /* -Qnew makes / true division, as in opcode_BINARY_DIVIDE */
+    if (opcode == BINARY_DIVIDE && _Py_QnewFlag)
+        opcode = BINARY_TRUE_DIVIDE;
+    while (op->opcode != opcode)
+        op++;
+    return op;
+}
+
+/* Look up the method implementing op for type op other on the class.
+   That is all binary_op1() and the slot_nb_* functions end up doing
+   for instances of classes that define the method in Python, when the
+   right operand has the same class or a builtin numeric type, and the
+   class doesn't also act as a sequence (sq_concat, sq_repeat). */
+static int
+fill_binop_cache(jit_binop_cache* cache, struct binop_method* op,
+                 PyTypeObject* type, PyTypeObject* other) {
+    PySequenceMethods* sq = type->tp_as_sequence;
+    PyObject* func;
+
+    cache->type = NULL;
+    if (other != type && other != &PyInt_Type &&
+        other != &PyLong_Type && other != &PyFloat_Type)
+        return 0;
+    if (sq != NULL && (sq->sq_concat != NULL || sq->sq_repeat != NULL))
+        return 0;
+    if (!_PyType_AssignVersionTag(type))
+        return 0;
+    if (op->name_str == NULL) {
+        op->name_str = PyString_InternFromString(op->name);
+        if (op->name_str == NULL) {
+            PyErr_Clear();
+            return 0;
+        }
+    }
+    func = _PyType_Lookup(type, op->name_str);
+    if (func == NULL || !PyFunction_Check(func))
+        return 0;
+    cache->type = type;
+    cache->other = other;
+    cache->version = type->tp_version_tag;
+    cache->func = func;
+    return 1;
+}
+
+/* BINARY_ADD and the other operators of binop_methods at a site with an
+   inline cache: for instances of a class that defines the operator in
+   Python, the method cached for the operand types is called directly,
+   without the dispatch through binary_op1(), slot_nb_add() and a bound
+   method.  Returns 2 for the site's regular handler to do the
+   operation. */
+CACHED_OPCODE(BINARY_OP_CACHED, jit_binop_cache) {
+    struct binop_method* op = binop_method_for(opcode);
+    PyObject* args[2];
+    PyObject** sp = args + 2;
+
+    w = TOP();
+    v = SECOND();
+    if (!(v->ob_type->tp_flags & Py_TPFLAGS_HEAPTYPE))
+        RETURN(2);
+    if (v->ob_type != cache->type || w->ob_type != cache->other ||
+        !(v->ob_type->tp_flags & Py_TPFLAGS_VALID_VERSION_TAG) ||
+        v->ob_type->tp_version_tag != cache->version) {
+        if (!fill_binop_cache(cache, op, v->ob_type, w->ob_type))
+            RETURN(2);
+    }
+    args[0] = v;
+    args[1] = w;
+    u = cache->func;
+    Py_INCREF(u);
+    x = fast_function(u, &sp, 2, 2, 0);
+    Py_DECREF(u);
+    if (x == Py_NotImplemented && w->ob_type != v->ob_type) {
+        /* binary_op1() gives the right operand a go */
+        Py_DECREF(x);
+        x = NB_BINOP(w->ob_type->tp_as_number, op->slot)(v, w);
+    }
+    if (x == Py_NotImplemented) {
+        Py_DECREF(x);
+        x = NULL;
+        PyErr_Format(PyExc_TypeError,
+                     "unsupported operand type(s) for %.100s: "
+                     "'%.100s' and '%.100s'",
+                     op->symbol, v->ob_type->tp_name, w->ob_type->tp_name);
+    }
+    STACKADJ(-1);
+    Py_DECREF(v);
+    Py_DECREF(w);
+    SET_TOP(x);
+    if (x != NULL) CONTINUE();
+    BREAK();
+} END_OPCODE
+
 FAT_OPCODE(BINARY_POWER) {
     w = POP();
     v = TOP();
@@ -2380,6 +3595,22 @@ FAT_OPCODE(SLICE) {
     BREAK();
 } END_OPCODE
 
+FAT_OPCODE(BUILD_SLICE) {
+    if (oparg == 3)
+        w = POP();
+    else
+        w = NULL;
+    v = POP();
+    u = TOP();
+    x = PySlice_New(u, v, w);
+    Py_DECREF(u);
+    Py_DECREF(v);
+    Py_XDECREF(w);
+    SET_TOP(x);
+    if (x != NULL) CONTINUE();
+    BREAK();
+} END_OPCODE
+
 FAT_OPCODE(STORE_SLICE) {
     if ((opcode-STORE_SLICE) & 2)
         w = POP();
@@ -2502,6 +3733,16 @@ FAT_OPCODE(UNPACK_SEQUENCE) {
     v = POP();
     if (PyTuple_CheckExact(v) && PyTuple_GET_SIZE(v) == oparg) {
         PyObject **items = ((PyTupleObject *)v)->ob_item;
+        if (v->ob_refcnt == 1) {
+            /* x, y = f(): nobody else sees the tuple, move the items
+               out instead of taking new references to them */
+            while (oparg--) {
+                PUSH(items[oparg]);
+                items[oparg] = NULL;
+            }
+            Py_DECREF(v);
+            CONTINUE();
+        }
         while (oparg--) {
             w = items[oparg];
             Py_INCREF(w);
@@ -2534,6 +3775,14 @@ OPCODE(BREAK_LOOP) {
     BREAK();
 } END_OPCODE
 
+OPCODE(CONTINUE_LOOP) {
+    RETVAL = PyInt_FromLong(oparg);
+    if (RETVAL == NULL)
+        BREAK();
+    WHY = WHY_CONTINUE;
+    BREAK();
+} END_OPCODE
+
 FAT_OPCODE(BINARY_LSHIFT) {
     w = POP();
     v = TOP();
@@ -1,4 +1,5 @@
 from test.test_support import verify, verbose, TestFailed, vereq
+import os
 import sys
 import gc
 import weakref
@@ -225,6 +226,132 @@ def test_get_count():
     a = dict()
     expect(gc.get_count(), (1, 0, 0), "get_count()")
 
+def test_freelists():
+    gc.compact_freelists()
+    before = gc.get_freelist_stats()
+    floats = [float(i) for i in xrange(100000)]
+    ints = range(1000, 101000)
+    grown = gc.get_freelist_stats()
+    verify(grown["float"]["used"] >= before["float"]["used"] + 100000)
+    verify(grown["int"]["used"] >= before["int"]["used"] + 100000)
+    for kind in "int", "float":
+        stats = grown[kind]
+        verify(stats["bytes"] >= stats["blocks"])
+    del floats, ints
+    expect_nonzero(gc.compact_freelists(), "freelists")
+    after = gc.get_freelist_stats()
+    verify(after["float"]["blocks"] < grown["float"]["blocks"])
+    verify(after["int"]["blocks"] < grown["int"]["blocks"])
+    verify(after["int"]["used"] < grown["int"]["used"])
+
+def allocate_lists():
+    return [[i] for i in xrange(1000)]
+
+def test_malloc_stats():
+    try:
+        before = gc.get_malloc_stats()
+    except NotImplementedError:
+        return
+    lists = allocate_lists()
+    after = gc.get_malloc_stats()
+    verify(after["arenas"] > 0)
+    verify(after["arenas_highwater"] >= after["arenas"])
+    verify(after["requested_bytes"] > before["requested_bytes"])
+    verify(after["allocated_bytes"] >= after["requested_bytes"])
+    expect(len(after["classes"]), len(before["classes"]), "malloc classes")
+    verify(sum([c[4] for c in after["classes"]]) >
+           sum([c[4] for c in before["classes"]]))
+    for size, pools, used, free, allocations in after["classes"]:
+        verify(used + free >= pools)
+    del lists
+
+    gc.take_malloc_samples()
+    gc.start_malloc_sampling(1024)
+    try:
+        for i in range(100):
+            lists = allocate_lists()
+    finally:
+        gc.stop_malloc_sampling()
+    samples = gc.take_malloc_samples()
+    code = allocate_lists.func_code
+    frames = [stack[-1] for stack in samples
+              if stack[-1][0] == code.co_filename
+              and stack[-1][2] == "allocate_lists"]
+    verify(frames)
+    expect(frames[0][1], code.co_firstlineno + 1, "malloc sample line")
+    verify(sum(samples.values()) >= 1024)
+    expect(gc.take_malloc_samples(), {}, "malloc samples taken")
+
+def test_release_free_pools():
+    try:
+        gc.get_malloc_stats()
+    except NotImplementedError:
+        return
+    # the batches kept keep the arenas of the others from being freed
+    # whole: a full collection leaves free pools in them, and gives
+    # their memory back
+    lists = [allocate_lists() for i in range(100)]
+    kept = lists[::10]
+    del lists
+    gc.collect()
+    stats = gc.get_malloc_stats()
+    verify(stats["released_pools"] <= stats["free_pools"])
+    if (sys.platform.startswith("linux") and
+        not os.environ.get("PYTHONMALLOCKEEPPOOLS")):
+        verify(stats["released_pools"] > 0)
+    # released pools are used again
+    lists = [allocate_lists() for i in range(100)]
+    if stats["released_pools"]:
+        verify(gc.get_malloc_stats()["released_pools"] <
+               stats["released_pools"])
+    expect(lists[-1][-1], [999], "list in a released pool")
+    del lists, kept
+    gc.collect()
+
+def test_immortalize():
+    # in a child process, as everything alive becomes immortal
+    import subprocess
+    code = """if 1:
+        import gc, sys, weakref
+        class C:
+            pass
+        c = C()
+        refs = sys.getrefcount(c)
+        gc.immortalize()
+        d = c
+        assert sys.getrefcount(c) == sys.getrefcount(d) > refs
+        r = weakref.ref(c)
+        del c, d
+        assert r() is not None
+        e = C()
+        r = weakref.ref(e)
+        del e
+        assert r() is None
+        """
+    expect(subprocess.call([sys.executable, "-c", code]), 0, "immortalize")
+
+class Frozen:
+    pass
+
+def test_freeze():
+    gc.collect()
+    gc.freeze()
+    try:
+        verify(gc.get_freeze_count() > 0)
+        a = Frozen()
+        a.a = a
+        wr = weakref.ref(a)
+        gc.freeze()
+        del a
+        gc.collect()
+        verify(wr() is not None)
+        verify(id(wr()) in map(id, gc.get_objects()))
+    finally:
+        gc.unfreeze()
+    expect(gc.get_freeze_count(), 0, "unfreeze")
+    gc.collect()
+    verify(wr() is None)
+
 def test_collect_generations():
     gc.collect()
     a = dict()
@@ -589,6 +716,11 @@ def test_all():
     run_test("__del__ (new class)", test_del_newclass)
     run_test("get_count()", test_get_count)
     run_test("collect(n)", test_collect_generations)
+    run_test("freelists", test_freelists)
+    run_test("malloc_stats", test_malloc_stats)
+    run_test("release_free_pools", test_release_free_pools)
+    run_test("immortalize", test_immortalize)
+    run_test("freeze", test_freeze)
     run_test("saveall", test_saveall)
     run_test("trashcan", test_trashcan)
     run_test("boom", test_boom)
@@ -0,0 +1,933 @@
+from __future__ import with_statement
+
+# Tests for the JIT compiler and its interpreter tier
+
+import dis
+import imp
+import marshal
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import unittest
+import StringIO
+from test import test_support
+
+import _jit
+
+class Context(object):
+    def __init__(self, swallow=False):
+        self.swallow = swallow
+        self.exited = None
+    def __enter__(self):
+        return self
+    def __exit__(self, *exc_info):
+        self.exited = exc_info
+        return self.swallow
+
+deleted_global = 1
+rebound_global = 0
+
+def load_rebound_global():
+    return rebound_global
+
+def load_len():
+    return len("abc")
+
+def never_called(x):
+    return [lambda: x * i for i in range(3)]
+
+class Precompiled(object):
+    @staticmethod
+    def static(x):
+        return x + 1
+    @property
+    def prop(self):
+        return 42
+
+class OpcodeTest(unittest.TestCase):
+
+    def test_with(self):
+        c = Context()
+        with c as d:
+            self.assert_(d is c)
+        self.assertEqual(c.exited, (None, None, None))
+        c = Context(swallow=True)
+        with c:
+            raise KeyError
+        self.assert_(c.exited[0] is KeyError)
+        def f():
+            with Context():
+                raise KeyError
+        self.assertRaises(KeyError, f)
+        def g():
+            for i in range(3):
+                with Context():
+                    return i
+        self.assertEqual(g(), 0)
+
+    def test_build_slice(self):
+        l = range(10)
+        self.assertEqual(l[1:8:2], [1, 3, 5, 7])
+        self.assertEqual(l[::-3], [9, 6, 3, 0])
+        l[::2] = [0] * 5
+        self.assertEqual(l, [0, 1, 0, 3, 0, 5, 0, 7, 0, 9])
+        del l[1::2]
+        self.assertEqual(l, [0] * 5)
+
+    def test_continue_loop(self):
+        seen = []
+        for i in range(5):
+            try:
+                if i % 2:
+                    continue
+                seen.append(i)
+            finally:
+                seen.append(-i)
+        self.assertEqual(seen, [0, 0, -1, 2, -2, -3, 4, -4])
+        seen = []
+        for i in range(4):
+            try:
+                if i == 2:
+                    continue
+            except ValueError:
+                pass
+            seen.append(i)
+        self.assertEqual(seen, [0, 1, 3])
+
+    def test_discarded_exception(self):
+        def get(d, keys):
+            found = []
+            for k in keys:
+                try:
+                    x = d[k]
+                except KeyError:
+                    x = None
+                except IndexError:
+                    x = -1
+                found.append(x)
+            return found
+        d = {1: "a", 3: "c"}
+        self.assertEqual(get(d, range(5)), [None, "a", None, "c", None])
+        self.assertEqual(get([0, 1], [1, 5]), [1, -1])
+        self.assertRaises(TypeError, get, d, [[]])
+        def exc_type(d, k):
+            try:
+                return d[k]
+            except KeyError:
+                return sys.exc_info()[0]
+        self.assert_(exc_type({}, 1) is KeyError)
+        def lookup(d, k):
+            try:
+                return d[k]
+            except KeyError:
+                return None
+        # code after the clause still sees the exception it dropped
+        def exc_type_later(d, k):
+            try:
+                d[k]
+            except KeyError:
+                pass
+            return sys.exc_info()[0]
+        def reraise(d, k):
+            try:
+                d[k]
+            except KeyError:
+                pass
+            raise
+        # past the baseline tier
+        for i in range(20):
+            self.assertEqual([lookup(d, k) for k in range(3)], [None, "a", None])
+            self.assert_(exc_type_later({}, 1) is KeyError)
+            self.assertRaises(KeyError, reraise, {}, 1)
+
+    def test_print_to(self):
+        out = StringIO.StringIO()
+        print >>out, 1, "two",
+        print >>out, 3.0
+        print >>out
+        self.assertEqual(out.getvalue(), "1 two 3.0\n\n")
+
+    def test_delete_global(self):
+        global deleted_global
+        del deleted_global
+        self.assertRaises(NameError, lambda: deleted_global)
+        def f():
+            global deleted_global
+            del deleted_global
+        self.assertRaises(NameError, f)
+        deleted_global = 1
+
+    def test_extended_arg(self):
+        source = "x = [%s]" % ", ".join([str(i) for i in range(70000)])
+        ns = {}
+        exec compile(source, "<extended_arg>", "exec") in ns
+        self.assertEqual(len(ns["x"]), 70000)
+        self.assertEqual(ns["x"][-1], 69999)
+
+class CallCacheTest(unittest.TestCase):
+
+    def test_intrinsics(self):
+        class Sized(object):
+            def __len__(self):
+                return 7
+        def check():
+            for x, n in [([1, 2], 2), ((), 0), ("abc", 3), ({1: 2}, 1),
+                         (Sized(), 7)]:
+                self.assertEqual(len(x), n)
+            self.assertRaises(TypeError, lambda: len(1))
+            for x in [1, True, 1.0, "s"]:
+                self.assertEqual(isinstance(x, int), type(x) in (int, bool))
+            self.assertEqual(isinstance(1, (str, int)), True)
+            self.assertRaises(TypeError, lambda: isinstance(1))
+            for x, y in [(3, 3), (-3, 3), (-2.5, 2.5),
+                         (-sys.maxint - 1, sys.maxint + 1)]:
+                self.assertEqual(abs(x), y)
+                self.assertEqual(type(abs(x)), type(y))
+            self.assert_(type(1) is int)
+            self.assert_(type("") is str)
+        _jit.compile(check)
+        check()
+
+    def test_shadowed_builtins(self):
+        import __builtin__
+        def f(x):
+            return len(x)
+        _jit.compile(f)
+        self.assertEqual(f([1]), 1)
+        old_len = __builtin__.len
+        __builtin__.len = lambda x: 42
+        try:
+            self.assertEqual(f([1]), 42)
+        finally:
+            __builtin__.len = old_len
+        self.assertEqual(f([1]), 1)
+        # another builtin under the name is called as itself
+        __builtin__.len = abs
+        try:
+            for i in range(20):
+                self.assertEqual(f(-3), 3)
+        finally:
+            __builtin__.len = old_len
+        self.assertEqual(f([1]), 1)
+
+    def test_builtins_rebound_first(self):
+        # the intrinsics don't depend on the bindings of the first call
+        code = ("import __builtin__, _jit\n"
+                "old_len = __builtin__.len\n"
+                "__builtin__.len = abs\n"
+                "def f(x):\n"
+                "    return len(x)\n"
+                "def g(x):\n"
+                "    return abs(x)\n"
+                "_jit.compile(f)\n"
+                "_jit.compile(g)\n"
+                "for i in range(3):\n"
+                "    assert f(-3) == 3\n"
+                "    assert g(-3) == 3\n"
+                "__builtin__.len = old_len\n"
+                "for i in range(3):\n"
+                "    assert f([1, 2]) == 2\n"
+                "    assert g(-3) == 3\n")
+        self.assertEqual(subprocess.call([sys.executable, "-c", code]), 0)
+
+    def test_methods(self):
+        results = []
+        for d in [{1: "a"}, {}, {1: "b"}]:
+            results.append(d.get(1))
+            results.append(d.get(2, "x"))
+        self.assertEqual(results, ["a", "x", None, "x", "b", "x"])
+        l = []
+        for x in range(3):
+            l.append(x)
+        self.assertEqual(l, [0, 1, 2])
+        self.assertEqual([max(x, 1) for x in range(3)], [1, 1, 2])
+
+def countdown(n=0):
+    if n:
+        return countdown(n=n - 1)
+    return n
+
+class KeywordCallTest(unittest.TestCase):
+
+    def test_recursion(self):
+        # the cache of the call site doesn't keep its callee's code alive
+        code = countdown.func_code
+        countdown(n=3)
+        before = sys.getrefcount(code)
+        for i in range(1100):
+            self.assertEqual(countdown(n=3), 0)
+        self.assertEqual(sys.getrefcount(code), before)
+
+    def test_binding(self):
+        def f(a, b, c=3, d=4):
+            return (a, b, c, d)
+        _jit.compile(f)
+        for i in range(3):
+            self.assertEqual(f(1, b=2), (1, 2, 3, 4))
+            self.assertEqual(f(1, d=5, b=2), (1, 2, 3, 5))
+            self.assertEqual(f(c=0, b=1, a=2), (2, 1, 0, 4))
+        class A(object):
+            def m(self, x, y=2):
+                return (self, x, y)
+        def call_m(a):
+            return a.m(y=3, x=1), A.m(a, y=3, x=1)
+        _jit.compile(call_m)
+        a = A()
+        self.assertEqual(call_m(a), ((a, 1, 3), (a, 1, 3)))
+
+    def test_changing_callees(self):
+        def f(x, y=1):
+            return x - y
+        def g(y, x=1):
+            return x - y
+        def h(**kw):
+            return kw["x"] - kw["y"]
+        class C(object):
+            def __init__(self, x, y):
+                self.v = x - y
+        def call(fn):
+            return fn(x=3, y=1)
+        def call_x(fn):
+            return fn(x=3)
+        _jit.compile(call)
+        _jit.compile(call_x)
+        results = []
+        for fn in [f, g, h, f, g, lambda x, y: x - y]:
+            results.append(call(fn))
+        self.assertEqual(results, [2] * 6)
+        self.assertEqual(call(C).v, 2)
+        self.assertEqual(call_x(f), 2)
+        f.func_defaults = (5,)
+        self.assertEqual(call_x(f), -2)
+        f.func_defaults = None
+        self.assertRaises(TypeError, call_x, f)
+
+    def test_errors(self):
+        def f(a, b=2):
+            return (a, b)
+        self.assertRaises(TypeError, lambda: f(b=1))
+        self.assertRaises(TypeError, lambda: f(1, a=1))
+        self.assertRaises(TypeError, lambda: f(1, c=1))
+        self.assertRaises(TypeError, lambda: f(1, 2, b=1))
+        self.assertEqual(f(1, **{"b": 3}), (1, 3))
+
+class MethodCallTest(unittest.TestCase):
+
+    def test_new_style(self):
+        class A(object):
+            def f(self, x=0):
+                return (self, x)
+        def call_f0(a):
+            return a.f()
+        _jit.compile(call_f0)
+        a = A()
+        self.assertEqual(call_f0(a), (a, 0))
+        self.assertEqual(a.f(1), (a, 1))
+        a.f = lambda x=2: x
+        self.assertEqual(call_f0(a), 2)
+        self.assertEqual(A.f(a, 3), (a, 3))
+        self.assertRaises(AttributeError, lambda: a.missing())
+
+    def test_classic(self):
+        class A:
+            def f(self, x=0):
+                return (self, x)
+        class B:
+            def __getattr__(self, name):
+                return lambda: name
+        def call_f(a, x):
+            return a.f(x)
+        def call_spam(b):
+            return b.spam()
+        _jit.compile(call_f)
+        _jit.compile(call_spam)
+        a = A()
+        self.assertEqual(call_f(a, 1), (a, 1))
+        a.f = len
+        self.assertEqual(call_f(a, "ab"), 2)
+        self.assertEqual(call_spam(B()), "spam")
+
+    def test_builtin_methods(self):
+        def check():
+            l = []
+            for x in range(3):
+                l.append(x)
+            self.assertEqual(l, [0, 1, 2])
+            self.assertEqual(l.pop(), 2)
+            self.assertEqual({1: 2}.get(1), 2)
+            self.assertEqual("a,b".split(","), ["a", "b"])
+            self.assertRaises(TypeError, lambda: l.append())
+            self.assertRaises(TypeError, lambda: list.append((), 1))
+        _jit.compile(check)
+        check()
+
+    def test_builtin_methods_profiled(self):
+        # profilers see builtin methods called through CALL_METHOD
+        events = []
+        def profiler(frame, event, arg):
+            if event.startswith("c_"):
+                events.append((event, arg.__name__))
+        def append(l):
+            l.append(42)
+        _jit.compile(append)
+        l = []
+        sys.setprofile(profiler)
+        try:
+            append(l)
+        finally:
+            sys.setprofile(None)
+        self.assertEqual(l, [42])
+        self.assertEqual(events[:2], [("c_call", "append"),
+                                      ("c_return", "append")])
+
+    def test_dynamic_attributes(self):
+        class A(object):
+            def __getattr__(self, name):
+                return lambda *args: (name, args)
+            g = property(lambda self: len)
+            h = staticmethod(lambda x: x * 2)
+            i = classmethod(lambda cls: cls)
+        def calls(a):
+            return a.spam(1), a.g("abc"), a.h(4), a.i()
+        _jit.compile(calls)
+        self.assertEqual(calls(A()), (("spam", (1,)), 3, 8, A))
+
+class SubscrTest(unittest.TestCase):
+
+    def test_get(self):
+        l, t, d = [1, 2, 3], (4, 5, 6), {"a": 7, 1: 8}
+        self.assertEqual([l[i] for i in range(-3, 3)], [1, 2, 3, 1, 2, 3])
+        self.assertEqual([t[i] for i in range(-3, 3)], [4, 5, 6, 4, 5, 6])
+        self.assertEqual((d["a"], d[1]), (7, 8))
+        self.assertRaises(IndexError, lambda: l[3])
+        self.assertRaises(IndexError, lambda: t[-4])
+        self.assertRaises(KeyError, lambda: d["b"])
+        self.assertEqual(l[True], 2)
+        self.assertEqual(l[1L], 2)
+
+    def test_changing_types(self):
+        class D(dict):
+            def __missing__(self, key):
+                return key * 2
+        def get(c, k):
+            return c[k]
+        for c, k, v in [([1], 0, 1), ((2,), 0, 2), ({"k": 3}, "k", 3),
+                        (D(), "k", "kk"), ("abc", 1, "b"), ([1], -1, 1)] * 20:
+            self.assertEqual(get(c, k), v)
+
+    def test_store(self):
+        def store(c, k, v):
+            c[k] = v
+        l, d = [0, 0], {}
+        for i in range(10):
+            store(l, i % 2, i)
+            store(d, str(i % 3), i)
+        self.assertEqual(l, [8, 9])
+        self.assertEqual(d, {"0": 9, "1": 7, "2": 8})
+        self.assertRaises(IndexError, store, l, 2, 0)
+        self.assertRaises(TypeError, store, (1,), 0, 0)
+        store(l, slice(0, 1), [5, 6])
+        self.assertEqual(l, [5, 6, 9])
+
+class TupleTest(unittest.TestCase):
+
+    def test_swap(self):
+        a, b, c, d, e = 1, 2, 3, 4, 5
+        a, b = b, a
+        self.assertEqual((a, b), (2, 1))
+        a, b, c, d, e = e, d, c, b, a
+        self.assertEqual((a, b, c, d, e), (5, 4, 3, 1, 2))
+        [a, b, c, d] = [d, c, b, a]
+        self.assertEqual((a, b, c, d), (1, 3, 4, 5))
+        a, = b,
+        self.assertEqual(a, 3)
+
+    def test_unpack_result(self):
+        def f(*args):
+            return args
+        t = (1, [2], "3")
+        x, y, z = f(*t)
+        self.assertEqual((x, y, z), t)
+        x, y, z = t
+        self.assertEqual((x, y, z), (1, [2], "3"))
+        self.assertEqual(t, (1, [2], "3"))
+        def g():
+            a, b = f(1, 2, 3)
+        self.assertRaises(ValueError, g)
+
+    def test_star_args(self):
+        def f(*args):
+            return args
+        t = (1, 2)
+        self.assertEqual(f(*t), t)
+        self.assertEqual(max(*t), 2)
+        self.assertEqual(f(0, *t), (0, 1, 2))
+        self.assertEqual(f(*[1, 2]), (1, 2))
+        class T(tuple):
+            pass
+        self.assertEqual(type(f(*T(t))), tuple)
+
+class BinopCacheTest(unittest.TestCase):
+
+    def test_same_class(self):
+        class V(object):
+            def __init__(self, x):
+                self.x = x
+            def __add__(self, other):
+                return V(self.x + other.x)
+            def __sub__(self, other):
+                return V(self.x - other.x)
+        v = V(0)
+        for i in range(10):
+            v = v + V(i) - V(1)
+        self.assertEqual(v.x, 35)
+
+    def test_changing_class(self):
+        class A(object):
+            def __add__(self, other):
+                return "A"
+        class B(A):
+            pass
+        def add(x, y):
+            return x + y
+        _jit.compile(add)
+        results = []
+        for i in range(3):
+            results.append(add(B(), B()))
+        A.__add__ = lambda self, other: "A2"
+        results.append(add(B(), B()))
+        B.__add__ = lambda self, other: "B"
+        results.append(add(B(), B()))
+        del B.__add__
+        results.append(add(B(), B()))
+        self.assertEqual(results, ["A"] * 3 + ["A2", "B", "A2"])
+
+    def test_new_division(self):
+        # under -Qnew / calls __truediv__, compiled or not
+        code = ("import _jit\n"
+                "class D(object):\n"
+                "    def __div__(self, other):\n"
+                "        return 'div'\n"
+                "    def __truediv__(self, other):\n"
+                "        return 'truediv'\n"
+                "def div(x, y):\n"
+                "    return x / y\n"
+                "_jit.compile(div)\n"
+                "for i in range(3):\n"
+                "    assert div(D(), D()) == 'truediv'\n"
+                "    assert div(D(), 2) == 'truediv'\n"
+                "assert div(1, 2) == 0.5\n")
+        self.assertEqual(subprocess.call([sys.executable, "-Qnew", "-c",
+                                          code]), 0)
+
+    def test_numeric_right_operand(self):
+        class M(object):
+            def __init__(self, c):
+                self.c = c
+            def __mul__(self, k):
+                if isinstance(k, M):
+                    return NotImplemented
+                return M(self.c * k)
+        for k in [2, 2L, 2.0]:
+            self.assertEqual((M(3) * k).c, 6)
+        self.assertRaises(TypeError, lambda: M(3) * M(3))
+        self.assertRaises(TypeError, lambda: M(3) / 2)
+
+    def test_not_implemented(self):
+        class I(int):
+            def __add__(self, other):
+                return NotImplemented
+        self.assertEqual(I(1) + 2, 3)
+        self.assertRaises(TypeError, lambda: I(1) + I(2))
+        class R(object):
+            def __radd__(self, other):
+                return "radd"
+        class L(object):
+            def __add__(self, other):
+                return NotImplemented
+        self.assertEqual(L() + R(), "radd")
+        self.assertEqual(1 + R(), "radd")
+        class S(list):
+            def __mul__(self, other):
+                return NotImplemented
+        self.assertEqual(S([1]) * 2, [1, 1])
+
+class ListCompTest(unittest.TestCase):
+
+    def test_sized_iterables(self):
+        for seq in [range(100), tuple(range(100)), dict.fromkeys(range(100)),
+                    xrange(100)]:
+            result = [x * 2 for x in seq]
+            self.assertEqual(sorted(result), range(0, 200, 2))
+            result.append(-1)
+            self.assertEqual(len(result), 101)
+        self.assertEqual([x for x in []], [])
+        self.assertEqual([x for x in xrange(0)], [])
+
+    def test_other_comprehensions(self):
+        self.assertEqual([x for x in range(10) if x % 2], [1, 3, 5, 7, 9])
+        self.assertEqual([x for y in [[1, 2], [3]] for x in y], [1, 2, 3])
+        self.assertEqual([x for x in [y for y in "ab"]], ["a", "b"])
+        self.assertEqual([x for x in (y for y in "ab")], ["a", "b"])
+        self.assertEqual([x for x in iter("ab")], ["a", "b"])
+
+    def test_exception(self):
+        def f(seq):
+            return [1 / x for x in seq]
+        self.assertRaises(ZeroDivisionError, f, [1, 0, 2])
+        self.assertEqual(f([1, 1]), [1, 1])
+
+class LoadCacheTest(unittest.TestCase):
+
+    def test_global_rebound(self):
+        global rebound_global
+        _jit.compile(load_rebound_global)
+        results = []
+        for i in range(4):
+            rebound_global = i
+            results.append(load_rebound_global())
+        self.assertEqual(results, [0, 1, 2, 3])
+        del rebound_global
+        self.assertRaises(NameError, load_rebound_global)
+        rebound_global = 0
+        self.assertEqual(load_rebound_global(), 0)
+
+    def test_builtin_shadowed(self):
+        _jit.compile(load_len)
+        self.assertEqual(load_len(), 3)
+        globals()["len"] = lambda x: 42
+        try:
+            self.assertEqual(load_len(), 42)
+        finally:
+            del globals()["len"]
+        self.assertEqual(load_len(), 3)
+
+    def test_instance_attribute(self):
+        class A(object):
+            y = "class"
+            def __init__(self):
+                self.x = "instance"
+        def get_x(obj):
+            return obj.x
+        def get_y(obj):
+            return obj.y
+        _jit.compile(get_x)
+        _jit.compile(get_y)
+        a = A()
+        for i in range(3):
+            self.assertEqual(get_x(a), "instance")
+            self.assertEqual(get_y(a), "class")
+        a.y = "shadowed"
+        self.assertEqual(get_y(a), "shadowed")
+        # a descriptor added to the class takes precedence again
+        A.x = property(lambda self: "property")
+        self.assertEqual(get_x(a), "property")
+        del A.x
+        self.assertEqual(get_x(a), "instance")
+        del a.x
+        self.assertRaises(AttributeError, get_x, a)
+
+    def test_other_objects(self):
+        class Classic:
+            def __init__(self):
+                self.x = "classic"
+            def __getattr__(self, name):
+                return "getattr"
+        class Slots(object):
+            __slots__ = ["x"]
+        class Hook(object):
+            def __getattr__(self, name):
+                return "getattr"
+        def get_x(obj):
+            return obj.x
+        s = Slots()
+        s.x = "slot"
+        objects = [Classic(), s, Hook()]
+        for i in range(3):
+            self.assertEqual(get_x(objects[0]), "classic")
+            self.assertEqual(get_x(objects[1]), "slot")
+            self.assertEqual(get_x(objects[2]), "getattr")
+        del objects[0].x
+        self.assertEqual(get_x(objects[0]), "getattr")
+
+def skip_five(x):
+    total = 0
+    for i in range(x):
+        if i == 5:
+            total -= 1
+        else:
+            total += i
+    return total
+
+def call_often(func, *args):
+    for i in xrange(1100):
+        func(*args)
+
+class TierTest(unittest.TestCase):
+
+    def test_stats(self):
+        stats = _jit.stats()
+        self.assert_(stats["compiled"] > 0)
+
+    def test_recompile(self):
+        before = _jit.stats()["recompiled"]
+        call_often(skip_five, 3)
+        self.assert_(_jit.stats()["recompiled"] >= before + 1)
+        # the branches never taken while profiling still work
+        self.assertEqual(skip_five(3), 3)
+        self.assertEqual(skip_five(7), 15)
+        self.assertEqual(skip_five(0), 0)
+
+    def test_hot_loop(self):
+        # a loop in code that runs once, like a module body, moves on to
+        # the recompiled code while it runs
+        source = ("total = 0\n"
+                  "try:\n"
+                  "    for i in xrange(5000):\n"
+                  "        if i % 3:\n"
+                  "            total += i\n"
+                  "        if i == 4000:\n"
+                  "            break\n"
+                  "    raise KeyError\n"
+                  "except KeyError:\n"
+                  "    total = -total\n")
+        before = _jit.stats()["recompiled"]
+        ns = {}
+        exec compile(source, "<hot loop>", "exec") in ns
+        self.assertEqual(ns["total"], -sum(i for i in xrange(4001) if i % 3))
+        self.assert_(_jit.stats()["recompiled"] >= before + 1)
+
+    def test_baseline(self):
+        def g(x):
+            return x + 1
+        before = _jit.stats()
+        self.assertEqual(g(1), 2)
+        stats = _jit.stats()
+        self.assertEqual(stats["baseline"], before["baseline"] + 1)
+        self.assertEqual(stats["compiled"], before["compiled"])
+        for i in range(20):
+            self.assertEqual(g(i), i + 1)
+        self.assertEqual(_jit.stats()["compiled"], before["compiled"] + 1)
+
+    def test_baseline_loop(self):
+        ns = {}
+        exec compile("def f(n):\n"
+                     "    total = 0\n"
+                     "    for i in xrange(n):\n"
+                     "        try:\n"
+                     "            total += i\n"
+                     "        except KeyError:\n"
+                     "            pass\n"
+                     "    return total\n", "<loop>", "exec") in ns
+        f = ns["f"]
+        before = _jit.stats()
+        self.assertEqual(f(3), 3)
+        stats = _jit.stats()
+        self.assertEqual(stats["baseline"], before["baseline"] + 1)
+        self.assertEqual(stats["compiled"], before["compiled"])
+        # a long loop moves on to compiled code while it runs
+        self.assertEqual(f(500), 124750)
+        self.assertEqual(_jit.stats()["compiled"], before["compiled"] + 1)
+
+    def test_compile_loaded_modules(self):
+        stats = _jit.stats()
+        self.assert_(_jit.compile_loaded_modules() > 0)
+        self.assert_(_jit.stats()["compiled"] > stats["compiled"])
+        # everything reachable is compiled now
+        self.assertEqual(_jit.compile_loaded_modules(), 0)
+        self.assertEqual([f() for f in never_called(2)], [0, 2, 4])
+        self.assertEqual(Precompiled.static(1), 2)
+        self.assertEqual(Precompiled().prop, 42)
+
+    def test_compile(self):
+        def f(x):
+            return [lambda: x]
+        before = _jit.stats()
+        self.assertEqual(_jit.compile(f), 2)
+        self.assertEqual(_jit.compile(f), 0)
+        self.assertEqual(_jit.compile(f.func_code), 0)
+        self.assertEqual(f(1)[0](), 1)
+        stats = _jit.stats()
+        self.assertEqual(stats["compiled"], before["compiled"] + 2)
+        self.assertEqual(stats["baseline"], before["baseline"])
+
+    def test_saved_profile(self):
+        source = "def h(x):\n    if x:\n        return 1\n    return 2\n"
+        dir = tempfile.mkdtemp()
+        path = os.path.join(dir, "jitprofiled.py")
+        f = open(path, "w")
+        f.write(source)
+        f.close()
+        h = compile(source, path, "exec").co_consts[0]
+        # branches at the JUMP_IF_FALSE of h only
+        jump = h.co_code.index(chr(dis.opmap["JUMP_IF_FALSE"]))
+        profiles = {(h.co_name, h.co_firstlineno, hash(h.co_code)):
+                    [(jump, 0, 100)]}
+        f = open(path[:-2] + "pyj", "wb")
+        f.write(imp.get_magic() + marshal.dumps(profiles))
+        f.close()
+        sys.path.insert(0, dir)
+        try:
+            import jitprofiled
+            before = _jit.stats()
+            self.assertEqual(jitprofiled.h(0), 2)
+            self.assertEqual(jitprofiled.h(1), 1)
+            # starts out in the baseline tier like any code ...
+            stats = _jit.stats()
+            self.assertEqual(stats["baseline"], before["baseline"] + 1)
+            self.assertEqual(stats["compiled"], before["compiled"])
+            # ... and then is compiled by its profile, without profiling
+            for i in range(1100):
+                jitprofiled.h(i & 1)
+            stats = _jit.stats()
+            self.assertEqual(stats["compiled"], before["compiled"] + 1)
+            self.assertEqual(stats["recompiled"], before["recompiled"])
+            # the profiles are written back whole, by a rename
+            env = dict(os.environ, PYTHONJITPROFILE="1")
+            code = "import jitprofiled\nfor i in range(1100): jitprofiled.h(i)\n"
+            self.assertEqual(subprocess.call([sys.executable, "-c", code],
+                                             cwd=dir, env=env), 0)
+            self.assertEqual(sorted(os.listdir(dir)),
+                             ["jitprofiled.py", "jitprofiled.pyc",
+                              "jitprofiled.pyj"])
+            f = open(path[:-2] + "pyj", "rb")
+            self.assertEqual(f.read(4), imp.get_magic())
+            self.assertEqual(marshal.load(f), profiles)
+            f.close()
+        finally:
+            sys.path.remove(dir)
+            sys.modules.pop("jitprofiled", None)
+            shutil.rmtree(dir)
+
+def traced(x):
+    y = x + 1
+    if y > 1:
+        raise ValueError
+    return y
+
+def jump_out_of_loop(output):
+    for i in 1, 2:
+        output.append(2)
+        output.append(3)
+    output.append(4)
+
+class TracingTest(unittest.TestCase):
+
+    def record(self, func, *args):
+        events = []
+        first = traced.func_code.co_firstlineno
+        def tracer(frame, event, arg):
+            if frame.f_code is traced.func_code:
+                events.append((event, frame.f_lineno - first))
+            return tracer
+        sys.settrace(tracer)
+        try:
+            try:
+                func(*args)
+            except ValueError:
+                pass
+        finally:
+            sys.settrace(None)
+        return events
+
+    def test_trace(self):
+        self.assertEqual(self.record(traced, 0),
+                         [("call", 0), ("line", 1), ("line", 2),
+                          ("line", 4), ("return", 4)])
+        self.assertEqual(self.record(traced, 1),
+                         [("call", 0), ("line", 1), ("line", 2),
+                          ("line", 3), ("exception", 3), ("return", 3)])
+        # compiled code runs again once the trace function is gone
+        self.assertEqual(traced(0), 1)
+
+    def test_profile(self):
+        events = []
+        def profiler(frame, event, arg):
+            if frame.f_code is traced.func_code:
+                events.append((event, arg))
+        sys.setprofile(profiler)
+        try:
+            traced(0)
+        finally:
+            sys.setprofile(None)
+        self.assertEqual(events, [("call", None), ("return", 1)])
+
+    def test_jump(self):
+        # as in test_trace: a jump out of the loop pops its iterator
+        code = jump_out_of_loop.func_code
+        def tracer(frame, event, arg):
+            if frame.f_code is code and event == "line" and \
+               frame.f_lineno == code.co_firstlineno + 3:
+                frame.f_lineno = code.co_firstlineno + 4
+            return tracer
+        for i in range(3):
+            output = []
+            sys.settrace(tracer)
+            try:
+                jump_out_of_loop(output)
+            finally:
+                sys.settrace(None)
+            self.assertEqual(output, [2, 4])
+        output = []
+        jump_out_of_loop(output)
+        self.assertEqual(output, [2, 3, 2, 3, 4])
+
+class SamplingTest(unittest.TestCase):
+
+    def busy(self):
+        total = 0
+        for i in xrange(100000):
+            total += i
+        return total
+
+    def test_samples(self):
+        if not hasattr(_jit, "start_sampling"):
+            return
+        self.assertRaises(ValueError, _jit.start_sampling, 0)
+        _jit.take_samples()
+        _jit.start_sampling(0.001)
+        try:
+            for i in range(1000):
+                self.busy()
+                samples = _jit.take_samples()
+                lines = [stack[-1] for stack in samples
+                         if stack[-1][2] == "busy"]
+                if lines:
+                    break
+        finally:
+            _jit.stop_sampling()
+        self.assert_(lines)
+        filename, lineno, name = lines[0]
+        self.assertEqual(filename, self.busy.im_func.func_code.co_filename)
+        first = self.busy.im_func.func_code.co_firstlineno
+        self.assert_(first < lineno <= first + 4)
+
+    def test_previous_handler(self):
+        if not hasattr(_jit, "start_sampling"):
+            return
+        import signal
+        received = []
+        def handler(signum, frame):
+            received.append(signum)
+        old = signal.signal(signal.SIGPROF, handler)
+        try:
+            _jit.start_sampling(0.001)
+            _jit.stop_sampling()
+            _jit.take_samples()
+            # stop_sampling() put the handler back
+            os.kill(os.getpid(), signal.SIGPROF)
+            self.assertEqual(received, [signal.SIGPROF])
+        finally:
+            signal.signal(signal.SIGPROF, old)
+
+
+def test_main():
+    test_support.run_unittest(OpcodeTest, CallCacheTest, KeywordCallTest,
+                              MethodCallTest, SubscrTest, TupleTest,
+                              BinopCacheTest, LoadCacheTest, ListCompTest,
+                              TierTest, SamplingTest, TracingTest)
+
+if __name__ == "__main__":
+    test_main()
@@ -221,11 +221,17 @@ class SysModuleTest(unittest.TestCase):
 
     def test_refcount(self):
         self.assertRaises(TypeError, sys.getrefcount)
+        o = object()
+        c = sys.getrefcount(o)
+        n = o
+        self.assertEqual(sys.getrefcount(o), c+1)
+        del n
+        self.assertEqual(sys.getrefcount(o), c)
+        # None is immortal: its reference count never changes
         c = sys.getrefcount(None)
         n = None
-        self.assertEqual(sys.getrefcount(None), c+1)
-        del n
         self.assertEqual(sys.getrefcount(None), c)
+        self.assert_(c > sys.maxint // 4)
         if hasattr(sys, "gettotalrefcount"):
             self.assert_(isinstance(sys.gettotalrefcount(), int))
 
@@ -105,6 +105,27 @@ def test():
             import sys
             sys.exc_traceback.__members__
 
+    def test_deep_traceback(self):
+        # the frames in between are recorded without traceback objects
+        # until the traceback is looked at
+        import sys
+        def recurse(n):
+            if n == 0:
+                raise ValueError
+            recurse(n - 1)
+        try:
+            recurse(20)
+        except ValueError:
+            tb = sys.exc_info()[2]
+        entries = traceback.extract_tb(tb)
+        self.assertEqual([name for _, _, name, _ in entries],
+                         ["test_deep_traceback"] + ["recurse"] * 21)
+        first = recurse.func_code.co_firstlineno
+        self.assertEqual(entries[-1][1], first + 2)
+        self.assertEqual([lineno for _, lineno, _, _ in entries[1:-1]],
+                         [first + 3] * 20)
+        self.assert_(tb.tb_next.tb_next.tb_frame.f_back is tb.tb_next.tb_frame)
+
     def test_base_exception(self):
         # Test that exceptions derived from BaseException are formatted right
         e = KeyboardInterrupt()
@@ -0,0 +1,404 @@
+/* _jit module: a window on the LLVM JIT (JitCompiler/). */
+
+#include "Python.h"
+#include "frameobject.h"
+#include "../JitCompiler/JitCompiler.h"
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <signal.h>
+
+/* The sampler needs a timer that counts the CPU time of the process */
+#ifdef ITIMER_PROF
+#define JIT_SAMPLING
+#endif
+
+PyDoc_STRVAR(jit_stats__doc__,
+"stats() -> dict\n\
+\n\
+Return counters describing how the code objects run so far were\n\
+executed.  'compiled' counts the code objects compiled to native code,\n\
+'recompiled' those of them that ran often enough to be compiled again,\n\
+laid out by their branch profile.  'baseline' counts the code objects\n\
+that started out in the interpreter tier, to be compiled once called a\n\
+few times or once their loops ran a while.");
+
+static PyObject *
+jit_stats(PyObject *self, PyObject *noargs)
+{
+	jit_stats_t stats;
+
+	get_jit_stats(&stats);
+	return Py_BuildValue("{s:l,s:l,s:l}",
+			     "compiled", stats.compiled,
+			     "recompiled", stats.recompiled,
+			     "baseline", stats.baseline);
+}
+
+static void
+precompile_code(PyCodeObject *co, long *count)
+{
+	Py_ssize_t i;
+	PyObject *c;
+
+	*count += precompile_jitted_function(co);
+	/* nested functions and lambdas */
+	for (i = 0; i < PyTuple_GET_SIZE(co->co_consts); i++) {
+		c = PyTuple_GET_ITEM(co->co_consts, i);
+		if (PyCode_Check(c))
+			precompile_code((PyCodeObject *)c, count);
+	}
+}
+
+static int precompile_dict(PyObject *dict, PyObject *owner,
+			   PyObject *seen, long *count);
+
+/* Precompile the code of v if it is a function, or of the functions it
+   wraps or holds if it is a method, a classmethod, a staticmethod, a
+   property or a class.  owner is the class whose dict holds v, if any.
+   Classes are only visited once, seen maps their addresses to None. */
+static int
+precompile_object(PyObject *v, PyObject *owner, PyObject *seen, long *count)
+{
+	PyObject *key, *f;
+	int err;
+	static char *accessors[] = {"fget", "fset", "fdel", NULL};
+	char **name;
+
+	if (PyFunction_Check(v)) {
+		precompile_code((PyCodeObject *)PyFunction_GET_CODE(v), count);
+		return 0;
+	}
+	if (PyMethod_Check(v))
+		return precompile_object(PyMethod_GET_FUNCTION(v), NULL,
+					 seen, count);
+	if ((v->ob_type == &PyStaticMethod_Type ||
+	     v->ob_type == &PyClassMethod_Type) && owner != NULL) {
+		f = v->ob_type->tp_descr_get(v, NULL, owner);
+		if (f == NULL)
+			return -1;
+		err = precompile_object(f, NULL, seen, count);
+		Py_DECREF(f);
+		return err;
+	}
+	if (v->ob_type == &PyProperty_Type) {
+		for (name = accessors; *name != NULL; name++) {
+			f = PyObject_GetAttrString(v, *name);
+			if (f == NULL)
+				return -1;
+			err = precompile_object(f, NULL, seen, count);
+			Py_DECREF(f);
+			if (err < 0)
+				return -1;
+		}
+		return 0;
+	}
+	if (!PyType_Check(v) && !PyClass_Check(v))
+		return 0;
+	key = PyLong_FromVoidPtr(v);
+	if (key == NULL)
+		return -1;
+	err = PyDict_GetItem(seen, key) != NULL;
+	if (!err)
+		err = PyDict_SetItem(seen, key, Py_None);
+	Py_DECREF(key);
+	if (err != 0)
+		return err < 0 ? -1 : 0;
+	if (PyType_Check(v))
+		return precompile_dict(((PyTypeObject *)v)->tp_dict, v,
+				       seen, count);
+	return precompile_dict(((PyClassObject *)v)->cl_dict, v,
+			       seen, count);
+}
+
+static int
+precompile_dict(PyObject *dict, PyObject *owner, PyObject *seen, long *count)
+{
+	Py_ssize_t pos = 0;
+	PyObject *key, *value;
+
+	if (dict == NULL || !PyDict_Check(dict))
+		return 0;
+	while (PyDict_Next(dict, &pos, &key, &value)) {
+		if (precompile_object(value, owner, seen, count) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+PyDoc_STRVAR(jit_compile_loaded_modules__doc__,
+"compile_loaded_modules() -> int\n\
+\n\
+Compile the functions and methods of all modules in sys.modules, and\n\
+the functions nested in them, ahead of their first call and without\n\
+branch counters; functions that already ran are compiled again with\n\
+the profile collected so far.  Nothing is compiled afterwards when\n\
+they are called, so a server that calls this before forking its\n\
+workers shares the machine code with all of them instead of having\n\
+each worker compile it again.  Return the number of code objects\n\
+compiled.");
+
+static PyObject *
+jit_compile_loaded_modules(PyObject *self, PyObject *noargs)
+{
+	PyObject *modules = PyImport_GetModuleDict();
+	PyObject *seen, *name, *module;
+	Py_ssize_t pos = 0;
+	long count = 0;
+
+	seen = PyDict_New();
+	if (seen == NULL)
+		return NULL;
+	prepare_jit_for_precompile();
+	while (PyDict_Next(modules, &pos, &name, &module)) {
+		if (!PyModule_Check(module))
+			continue;
+		if (precompile_dict(PyModule_GetDict(module), NULL,
+				    seen, &count) < 0) {
+			Py_DECREF(seen);
+			return NULL;
+		}
+	}
+	Py_DECREF(seen);
+	return PyInt_FromLong(count);
+}
+
+PyDoc_STRVAR(jit_compile__doc__,
+"compile(obj) -> int\n\
+\n\
+Compile the code of a function, method, class or code object, and of\n\
+the functions nested in it, like compile_loaded_modules() does, skipping\n\
+the interpreter tier.  Mostly for tests of the compiled code.  Return\n\
+the number of code objects compiled.");
+
+static PyObject *
+jit_compile(PyObject *self, PyObject *obj)
+{
+	PyObject *seen;
+	long count = 0;
+
+	if (PyCode_Check(obj)) {
+		precompile_code((PyCodeObject *)obj, &count);
+		return PyInt_FromLong(count);
+	}
+	seen = PyDict_New();
+	if (seen == NULL)
+		return NULL;
+	if (precompile_object(obj, NULL, seen, &count) < 0) {
+		Py_DECREF(seen);
+		return NULL;
+	}
+	Py_DECREF(seen);
+	return PyInt_FromLong(count);
+}
+
+#ifdef JIT_SAMPLING
+
+/* Stacks sampled since the last take_samples(): a tuple of
+   (filename, lineno, name) for each frame, outermost first, mapped to
+   the number of samples. */
+static PyObject *samples = NULL;
+
+/* Called with the GIL held, at the next periodic check after SIGPROF */
+static void
+take_sample(PyThreadState *tstate)
+{
+	PyObject *type, *value, *traceback;
+	PyObject *stack = NULL, *count = NULL, *entry;
+	PyFrameObject *f;
+	PyCodeObject *co;
+	Py_ssize_t depth = 0;
+
+	if (samples == NULL)
+		return;
+	PyErr_Fetch(&type, &value, &traceback);
+	for (f = tstate->frame; f != NULL; f = f->f_back)
+		depth++;
+	stack = PyTuple_New(depth);
+	if (stack == NULL)
+		goto error;
+	for (f = tstate->frame; f != NULL; f = f->f_back) {
+		co = f->f_code;
+		entry = Py_BuildValue("(OiO)", co->co_filename,
+				      PyCode_Addr2Line(co, f->f_lasti),
+				      co->co_name);
+		if (entry == NULL)
+			goto error;
+		PyTuple_SET_ITEM(stack, --depth, entry);
+	}
+	count = PyDict_GetItem(samples, stack);
+	count = PyInt_FromLong(count == NULL ? 1 : PyInt_AS_LONG(count) + 1);
+	if (count != NULL)
+		PyDict_SetItem(samples, stack, count);
+  error:
+	Py_XDECREF(stack);
+	Py_XDECREF(count);
+	/* a sample lost to MemoryError is not worth reporting */
+	PyErr_Clear();
+	PyErr_Restore(type, value, traceback);
+}
+
+static void
+sample_signal_handler(int signum)
+{
+	jit_sample_pending = 1;
+	_Py_Ticker = 0;
+}
+
+/* The SIGPROF handler from before start_sampling(), put back by
+   stop_sampling() */
+static int sample_handler_set = 0;
+#ifdef HAVE_SIGACTION
+static struct sigaction saved_action;
+#else
+static PyOS_sighandler_t saved_handler;
+#endif
+
+static int
+set_sample_handler(void)
+{
+#ifdef HAVE_SIGACTION
+	struct sigaction action;
+
+	action.sa_handler = sample_signal_handler;
+	sigemptyset(&action.sa_mask);
+	/* don't make blocking system calls fail with EINTR */
+	action.sa_flags = SA_RESTART;
+	if (sigaction(SIGPROF, &action, &saved_action) < 0)
+		return -1;
+#else
+	saved_handler = PyOS_setsig(SIGPROF, sample_signal_handler);
+	if (saved_handler == SIG_ERR)
+		return -1;
+#endif
+	sample_handler_set = 1;
+	return 0;
+}
+
+static int
+restore_sample_handler(void)
+{
+	if (!sample_handler_set)
+		return 0;
+#ifdef HAVE_SIGACTION
+	if (sigaction(SIGPROF, &saved_action, NULL) < 0)
+		return -1;
+#else
+	if (PyOS_setsig(SIGPROF, saved_handler) == SIG_ERR)
+		return -1;
+#endif
+	sample_handler_set = 0;
+	return 0;
+}
+
+PyDoc_STRVAR(jit_start_sampling__doc__,
+"start_sampling([interval]) -> None\n\
+\n\
+Sample the Python stack of the running thread every interval seconds\n\
+of CPU time (default 0.01), until stop_sampling().  The samples are\n\
+taken when the thread next checks for signals and thread switches,\n\
+and use SIGPROF.");
+
+static PyObject *
+jit_start_sampling(PyObject *self, PyObject *args)
+{
+	double interval = 0.01;
+	struct itimerval timer;
+
+	if (!PyArg_ParseTuple(args, "|d:start_sampling", &interval))
+		return NULL;
+	if (interval <= 0.0) {
+		PyErr_SetString(PyExc_ValueError,
+				"sampling interval must be positive");
+		return NULL;
+	}
+	if (samples == NULL) {
+		samples = PyDict_New();
+		if (samples == NULL)
+			return NULL;
+	}
+	jit_sample_hook = take_sample;
+	if (!sample_handler_set && set_sample_handler() < 0)
+		return PyErr_SetFromErrno(PyExc_OSError);
+	timer.it_interval.tv_sec = (long)interval;
+	timer.it_interval.tv_usec =
+		(long)((interval - timer.it_interval.tv_sec) * 1e6);
+	if (timer.it_interval.tv_sec == 0 && timer.it_interval.tv_usec == 0)
+		timer.it_interval.tv_usec = 1;
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_PROF, &timer, NULL) < 0)
+		return PyErr_SetFromErrno(PyExc_OSError);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyDoc_STRVAR(jit_stop_sampling__doc__,
+"stop_sampling() -> None\n\
+\n\
+Stop the sampling started by start_sampling().");
+
+static PyObject *
+jit_stop_sampling(PyObject *self, PyObject *noargs)
+{
+	struct itimerval timer;
+
+	memset(&timer, 0, sizeof(timer));
+	if (setitimer(ITIMER_PROF, &timer, NULL) < 0)
+		return PyErr_SetFromErrno(PyExc_OSError);
+	/* the timer is stopped: give SIGPROF back to whoever had it */
+	if (restore_sample_handler() < 0)
+		return PyErr_SetFromErrno(PyExc_OSError);
+	jit_sample_pending = 0;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyDoc_STRVAR(jit_take_samples__doc__,
+"take_samples() -> dict\n\
+\n\
+Return the stacks sampled so far and start counting afresh.  Each\n\
+stack is a tuple of (filename, lineno, function name) for each frame,\n\
+outermost first, mapped to the number of times it was sampled.");
+
+static PyObject *
+jit_take_samples(PyObject *self, PyObject *noargs)
+{
+	PyObject *result = samples;
+
+	samples = PyDict_New();
+	if (samples == NULL) {
+		samples = result;
+		return NULL;
+	}
+	if (result == NULL)
+		result = PyDict_New();
+	return result;
+}
+
+#endif /* JIT_SAMPLING */
+
+static PyMethodDef jit_methods[] = {
+	{"stats",	jit_stats,	METH_NOARGS,	jit_stats__doc__},
+	{"compile_loaded_modules", jit_compile_loaded_modules, METH_NOARGS,
+	 jit_compile_loaded_modules__doc__},
+	{"compile",	jit_compile,	METH_O,		jit_compile__doc__},
+#ifdef JIT_SAMPLING
+	{"start_sampling", jit_start_sampling, METH_VARARGS,
+	 jit_start_sampling__doc__},
+	{"stop_sampling", jit_stop_sampling, METH_NOARGS,
+	 jit_stop_sampling__doc__},
+	{"take_samples", jit_take_samples, METH_NOARGS,
+	 jit_take_samples__doc__},
+#endif
+	{NULL,		NULL}		/* sentinel */
+};
+
+PyDoc_STRVAR(jit__doc__,
+"Introspection of the JIT compiler that runs all Python code.");
+
+PyMODINIT_FUNC
+init_jit(void)
+{
+	Py_InitModule3("_jit", jit_methods, jit__doc__);
+}
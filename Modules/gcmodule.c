@@ -48,6 +48,18 @@ static struct gc_generation generations[NUM_GENERATIONS] = {
 
 PyGC_Head *_PyGC_generation0 = GEN_HEAD(0);
 
+/* Objects moved out of the generations by gc.freeze(): no collection
+ * looks at them, so that their PyGC_Heads are not written to. */
+static struct gc_generation permanent_generation = {
+	{{&permanent_generation.head, &permanent_generation.head, 0}}, 0, 0
+};
+#define PERMANENT_HEAD (&permanent_generation.head)
+
+/* Every list of tracked objects, for walking over all of them */
+#define NUM_TRACKED_LISTS (NUM_GENERATIONS + 1)
+#define TRACKED_LIST(n) \
+	((n) < NUM_GENERATIONS ? GEN_HEAD(n) : PERMANENT_HEAD)
+
 static int enabled = 1; /* automatic collection enabled? */
 
 /* true if we are currently running the collector */
@@ -874,6 +886,16 @@ collect(int generation)
 	 */
 	(void)handle_finalizers(&finalizers, old);
 
+	/* Return the int and float blocks that hold no live objects any
+	 * more to the allocator, and the allocator's free pools to the
+	 * system, so that the memory of a process follows its live data
+	 * rather than its peak. */
+	if (generation == NUM_GENERATIONS-1) {
+		(void)PyInt_CompactFreeList();
+		(void)PyFloat_CompactFreeList();
+		(void)_PyObject_ReleaseFreePools();
+	}
+
 	if (PyErr_Occurred()) {
 		if (gc_str == NULL)
 			gc_str = PyString_FromString("garbage collection");
@@ -1061,6 +1083,210 @@ gc_get_count(PyObject *self, PyObject *noargs)
 			     generations[2].count);
 }
 
+PyDoc_STRVAR(gc_compact_freelists__doc__,
+"compact_freelists() -> n\n"
+"\n"
+"Free the blocks of the int and float free lists that hold no live\n"
+"objects.  Full collections do this too.  Returns the number of blocks\n"
+"freed.\n");
+
+static PyObject *
+gc_compact_freelists(PyObject *self, PyObject *noargs)
+{
+	int n = PyInt_CompactFreeList();
+	n += PyFloat_CompactFreeList();
+	return PyInt_FromLong(n);
+}
+
+PyDoc_STRVAR(gc_get_freelist_stats__doc__,
+"get_freelist_stats() -> dict\n"
+"\n"
+"Return the occupancy of the int and float free lists: a dict mapping\n"
+"'int' and 'float' to dicts with the number of 'blocks' allocated,\n"
+"their size in 'bytes', and the number of objects in them that are\n"
+"'used' and 'free'.\n");
+
+static PyObject *
+freelist_stats(void (*get_stats)(Py_ssize_t *, Py_ssize_t *,
+				 Py_ssize_t *, Py_ssize_t *))
+{
+	Py_ssize_t nblocks, nbytes, nused, nfree;
+
+	get_stats(&nblocks, &nbytes, &nused, &nfree);
+	return Py_BuildValue("{s:n,s:n,s:n,s:n}",
+			     "blocks", nblocks, "bytes", nbytes,
+			     "used", nused, "free", nfree);
+}
+
+static PyObject *
+gc_get_freelist_stats(PyObject *self, PyObject *noargs)
+{
+	PyObject *ints, *floats, *result;
+
+	ints = freelist_stats(PyInt_GetFreeListStats);
+	floats = freelist_stats(PyFloat_GetFreeListStats);
+	if (ints == NULL || floats == NULL)
+		result = NULL;
+	else
+		result = Py_BuildValue("{s:O,s:O}",
+				       "int", ints, "float", floats);
+	Py_XDECREF(ints);
+	Py_XDECREF(floats);
+	return result;
+}
+
+PyDoc_STRVAR(gc_get_malloc_stats__doc__,
+"get_malloc_stats() -> dict\n"
+"\n"
+"Return the counters of the object allocator: the number of 'arenas'\n"
+"in use, their 'arenas_highwater' mark, 'arena_size', 'pool_size',\n"
+"'free_pools' and the 'released_pools' among them whose memory went\n"
+"back to the system, the 'requested_bytes' asked for and the\n"
+"'allocated_bytes' handed out for them, the 'bytes_in_use' in blocks,\n"
+"the 'large_allocations' and 'large_bytes' passed on to malloc(), and\n"
+"the 'dropped_samples' of take_malloc_samples().  'classes' lists a\n"
+"tuple (block size, pools, used blocks, free blocks, allocations) for\n"
+"each size class.\n");
+
+static PyObject *
+gc_get_malloc_stats(PyObject *self, PyObject *noargs)
+{
+	return _PyObject_GetMallocStats();
+}
+
+PyDoc_STRVAR(gc_start_malloc_sampling__doc__,
+"start_malloc_sampling(interval) -> None\n"
+"\n"
+"Record the Python stack of the allocating thread about every interval\n"
+"bytes requested from the object allocator, until\n"
+"stop_malloc_sampling().\n");
+
+static PyObject *
+gc_start_malloc_sampling(PyObject *self, PyObject *args)
+{
+	Py_ssize_t interval;
+
+	if (!PyArg_ParseTuple(args, "n:start_malloc_sampling", &interval))
+		return NULL;
+	if (interval <= 0) {
+		PyErr_SetString(PyExc_ValueError,
+				"sampling interval must be positive");
+		return NULL;
+	}
+	if (_PyObject_SetMallocSampling((size_t)interval) < 0)
+		return NULL;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyDoc_STRVAR(gc_stop_malloc_sampling__doc__,
+"stop_malloc_sampling() -> None\n"
+"\n"
+"Stop the sampling started by start_malloc_sampling().\n");
+
+static PyObject *
+gc_stop_malloc_sampling(PyObject *self, PyObject *noargs)
+{
+	if (_PyObject_SetMallocSampling(0) < 0)
+		return NULL;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyDoc_STRVAR(gc_take_malloc_samples__doc__,
+"take_malloc_samples() -> dict\n"
+"\n"
+"Return the allocations sampled so far and start afresh.  Each stack is\n"
+"a tuple of (filename, lineno, function name) for each frame, outermost\n"
+"first, mapped to the number of bytes its samples stand for.\n");
+
+static PyObject *
+gc_take_malloc_samples(PyObject *self, PyObject *noargs)
+{
+	return _PyObject_TakeMallocSamples();
+}
+
+PyDoc_STRVAR(gc_freeze__doc__,
+"freeze() -> None\n"
+"\n"
+"Move all the objects tracked by the collector to a permanent\n"
+"generation that collections ignore, until unfreeze().  A process can\n"
+"call this before forking workers, so that their collections don't\n"
+"copy the pages holding its objects.\n");
+
+static PyObject *
+gc_freeze(PyObject *self, PyObject *noargs)
+{
+	int i;
+
+	for (i = 0; i < NUM_GENERATIONS; i++) {
+		gc_list_merge(GEN_HEAD(i), PERMANENT_HEAD);
+		generations[i].count = 0;
+	}
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyDoc_STRVAR(gc_unfreeze__doc__,
+"unfreeze() -> None\n"
+"\n"
+"Move the objects frozen by freeze() back to the oldest generation.\n");
+
+static PyObject *
+gc_unfreeze(PyObject *self, PyObject *noargs)
+{
+	gc_list_merge(PERMANENT_HEAD, GEN_HEAD(NUM_GENERATIONS-1));
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+PyDoc_STRVAR(gc_get_freeze_count__doc__,
+"get_freeze_count() -> n\n"
+"\n"
+"Return the number of objects in the permanent generation.\n");
+
+static PyObject *
+gc_get_freeze_count(PyObject *self, PyObject *noargs)
+{
+	return PyInt_FromSsize_t(gc_list_size(PERMANENT_HEAD));
+}
+
+static int
+visit_immortalize(PyObject *op, void *data)
+{
+	_Py_SetImmortal(op);
+	return 0;
+}
+
+PyDoc_STRVAR(gc_immortalize__doc__,
+"immortalize() -> None\n"
+"\n"
+"Make the objects tracked by the collector, the objects they refer to\n"
+"and the interned strings immortal: they are never freed, and their\n"
+"reference counts are no longer written, so that processes forked\n"
+"afterwards keep sharing the memory that holds them.\n");
+
+static PyObject *
+gc_immortalize(PyObject *self, PyObject *noargs)
+{
+	PyGC_Head *list, *gc;
+	PyObject *op;
+	int i;
+
+	for (i = 0; i < NUM_TRACKED_LISTS; i++) {
+		list = TRACKED_LIST(i);
+		for (gc = list->gc.gc_next; gc != list; gc = gc->gc.gc_next) {
+			op = FROM_GC(gc);
+			_Py_SetImmortal(op);
+			(void) op->ob_type->tp_traverse(op,
+				(visitproc)visit_immortalize, NULL);
+		}
+	}
+	_PyString_ImmortalizeInterned();
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
 static int
 referrersvisit(PyObject* obj, PyObject *objs)
 {
@@ -1101,8 +1327,8 @@ gc_get_referrers(PyObject *self, PyObject *args)
 	PyObject *result = PyList_New(0);
 	if (!result) return NULL;
 
-	for (i = 0; i < NUM_GENERATIONS; i++) {
-		if (!(gc_referrers_for(args, GEN_HEAD(i), result))) {
+	for (i = 0; i < NUM_TRACKED_LISTS; i++) {
+		if (!(gc_referrers_for(args, TRACKED_LIST(i), result))) {
 			Py_DECREF(result);
 			return NULL;
 		}
@@ -1162,8 +1388,8 @@ gc_get_objects(PyObject *self, PyObject *noargs)
 	result = PyList_New(0);
 	if (result == NULL)
 		return NULL;
-	for (i = 0; i < NUM_GENERATIONS; i++) {
-		if (append_objects(result, GEN_HEAD(i))) {
+	for (i = 0; i < NUM_TRACKED_LISTS; i++) {
+		if (append_objects(result, TRACKED_LIST(i))) {
 			Py_DECREF(result);
 			return NULL;
 		}
@@ -1186,7 +1412,17 @@ PyDoc_STRVAR(gc__doc__,
 "get_threshold() -- Return the current the collection thresholds.\n"
 "get_objects() -- Return a list of all objects tracked by the collector.\n"
 "get_referrers() -- Return the list of objects that refer to an object.\n"
-"get_referents() -- Return the list of objects that an object refers to.\n");
+"get_referents() -- Return the list of objects that an object refers to.\n"
+"compact_freelists() -- Free the empty blocks of the int and float free lists.\n"
+"get_freelist_stats() -- Return the occupancy of the int and float free lists.\n"
+"get_malloc_stats() -- Return the counters of the object allocator.\n"
+"start_malloc_sampling() -- Sample the Python stacks that allocate memory.\n"
+"stop_malloc_sampling() -- Stop sampling allocations.\n"
+"take_malloc_samples() -- Return the allocations sampled so far.\n"
+"immortalize() -- Make all objects alive now immortal.\n"
+"freeze() -- Move all tracked objects out of reach of collections.\n"
+"unfreeze() -- Move the frozen objects back to the oldest generation.\n"
+"get_freeze_count() -- Return the number of frozen objects.\n");
 
 static PyMethodDef GcMethods[] = {
 	{"enable",	   gc_enable,	  METH_NOARGS,  gc_enable__doc__},
@@ -1204,6 +1440,24 @@ static PyMethodDef GcMethods[] = {
 		gc_get_referrers__doc__},
 	{"get_referents",  gc_get_referents, METH_VARARGS,
 		gc_get_referents__doc__},
+	{"compact_freelists", gc_compact_freelists, METH_NOARGS,
+		gc_compact_freelists__doc__},
+	{"get_freelist_stats", gc_get_freelist_stats, METH_NOARGS,
+		gc_get_freelist_stats__doc__},
+	{"get_malloc_stats", gc_get_malloc_stats, METH_NOARGS,
+		gc_get_malloc_stats__doc__},
+	{"start_malloc_sampling", gc_start_malloc_sampling, METH_VARARGS,
+		gc_start_malloc_sampling__doc__},
+	{"stop_malloc_sampling", gc_stop_malloc_sampling, METH_NOARGS,
+		gc_stop_malloc_sampling__doc__},
+	{"take_malloc_samples", gc_take_malloc_samples, METH_NOARGS,
+		gc_take_malloc_samples__doc__},
+	{"immortalize", gc_immortalize, METH_NOARGS,
+		gc_immortalize__doc__},
+	{"freeze",	   gc_freeze,	  METH_NOARGS,  gc_freeze__doc__},
+	{"unfreeze",	   gc_unfreeze,	  METH_NOARGS,  gc_unfreeze__doc__},
+	{"get_freeze_count", gc_get_freeze_count, METH_NOARGS,
+		gc_get_freeze_count__doc__},
 	{NULL,	NULL}		/* Sentinel */
 };
 
@@ -739,6 +739,28 @@ instance_getattr2(register PyInstanceObject *inst, PyObject *name)
 	return v;
 }
 
+/* Helper for _PyObject_GetMethod(): return a new reference to the plain
+   function that looking up name on inst would bind to it, or NULL (with
+   no exception set) if the attribute is anything else. */
+PyObject *
+_PyInstance_GetMethod(PyObject *op, PyObject *name)
+{
+	PyInstanceObject *inst = (PyInstanceObject *)op;
+	char *sname = PyString_AS_STRING(name);
+	PyClassObject *klass;
+	PyObject *v;
+
+	if (strcmp(sname, "__dict__") == 0 || strcmp(sname, "__class__") == 0)
+		return NULL;
+	if (PyDict_GetItem(inst->in_dict, name) != NULL)
+		return NULL;
+	v = class_lookup(inst->in_class, name, &klass);
+	if (v == NULL || !PyFunction_Check(v))
+		return NULL;
+	Py_INCREF(v);
+	return v;
+}
+
 static PyObject *
 instance_getattr(register PyInstanceObject *inst, PyObject *name)
 {
@@ -184,6 +184,11 @@ show_counts(void)
 	INIT_NONZERO_DICT_SLOTS(mp);					\
     } while(0)
 
+/* Source of ma_version: every dict takes the next version when it is
+   created and whenever its items change. */
+static unsigned PY_LONG_LONG dict_version = 0;
+#define NEW_VERSION(mp) ((mp)->ma_version = ++dict_version)
+
 /* Dictionary reuse scheme to save calls to malloc, free, and memset */
 #define MAXFREEDICTS 80
 static PyDictObject *free_dicts[MAXFREEDICTS];
@@ -219,6 +224,7 @@ PyDict_New(void)
 		EMPTY_TO_MINSIZE(mp);
 	}
 	mp->ma_lookup = lookdict_string;
+	NEW_VERSION(mp);
 #ifdef SHOW_CONVERSION_COUNTS
 	++created;
 #endif
@@ -410,6 +416,7 @@ insertdict(register dictobject *mp, PyObject *key, long hash, PyObject *value)
 		Py_DECREF(value);
 		return -1;
 	}
+	NEW_VERSION(mp);
 	if (ep->me_value != NULL) {
 		old_value = ep->me_value;
 		ep->me_value = value;
@@ -686,6 +693,7 @@ PyDict_DelItem(PyObject *op, PyObject *key)
 		set_key_error(key);
 		return -1;
 	}
+	NEW_VERSION(mp);
 	old_key = ep->me_key;
 	Py_INCREF(dummy);
 	ep->me_key = dummy;
@@ -717,6 +725,7 @@ PyDict_Clear(PyObject *op)
 	i = 0;
 #endif
 
+	NEW_VERSION(mp);
 	table = mp->ma_table;
 	assert(table != NULL);
 	table_is_malloced = table != mp->ma_smalltable;
@@ -1813,6 +1822,7 @@ dict_pop(dictobject *mp, PyObject *args)
 		set_key_error(key);
 		return NULL;
 	}
+	NEW_VERSION(mp);
 	old_key = ep->me_key;
 	Py_INCREF(dummy);
 	ep->me_key = dummy;
@@ -1870,6 +1880,7 @@ dict_popitem(dictobject *mp)
 				i = 1;
 		}
 	}
+	NEW_VERSION(mp);
 	PyTuple_SET_ITEM(res, 0, ep->me_key);
 	PyTuple_SET_ITEM(res, 1, ep->me_value);
 	Py_INCREF(dummy);
@@ -2075,6 +2086,7 @@ dict_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 		assert(d->ma_table == NULL && d->ma_fill == 0 && d->ma_used == 0);
 		INIT_NONZERO_DICT_SLOTS(d);
 		d->ma_lookup = lookdict_string;
+		NEW_VERSION(d);
 #ifdef SHOW_CONVERSION_COUNTS
 		++created;
 #endif
@@ -1255,32 +1255,35 @@ _PyFloat_Init(void)
 	float_format = detected_float_format;
 }
 
-void
-PyFloat_Fini(void)
+/* Number of live floats in a block */
+static int
+block_used(PyFloatBlock *list)
+{
+	PyFloatObject *p;
+	unsigned i;
+	int used = 0;
+
+	for (i = 0, p = &list->objects[0]; i < N_FLOATOBJECTS; i++, p++) {
+		if (PyFloat_CheckExact(p) && p->ob_refcnt != 0)
+			used++;
+	}
+	return used;
+}
+
+int
+PyFloat_CompactFreeList(void)
 {
 	PyFloatObject *p;
 	PyFloatBlock *list, *next;
 	unsigned i;
-	int bc, bf;	/* block count, number of freed blocks */
-	int frem, fsum;	/* remaining unfreed floats per block, total */
+	int freed = 0;
 
-	bc = 0;
-	bf = 0;
-	fsum = 0;
 	list = block_list;
 	block_list = NULL;
 	free_list = NULL;
 	while (list != NULL) {
-		bc++;
-		frem = 0;
-		for (i = 0, p = &list->objects[0];
-		     i < N_FLOATOBJECTS;
-		     i++, p++) {
-			if (PyFloat_CheckExact(p) && p->ob_refcnt != 0)
-				frem++;
-		}
 		next = list->next;
-		if (frem) {
+		if (block_used(list)) {
 			list->next = block_list;
 			block_list = list;
 			for (i = 0, p = &list->objects[0];
@@ -1296,11 +1299,46 @@ PyFloat_Fini(void)
 		}
 		else {
 			PyMem_FREE(list); /* XXX PyObject_FREE ??? */
-			bf++;
+			freed++;
 		}
-		fsum += frem;
 		list = next;
 	}
+	return freed;
+}
+
+void
+PyFloat_GetFreeListStats(Py_ssize_t *nblocks, Py_ssize_t *nbytes,
+			 Py_ssize_t *nused, Py_ssize_t *nfree)
+{
+	PyFloatBlock *list;
+	PyFloatObject *p;
+
+	*nblocks = 0;
+	for (list = block_list; list != NULL; list = list->next)
+		++*nblocks;
+	*nfree = 0;
+	for (p = free_list; p != NULL; p = (PyFloatObject *)p->ob_type)
+		++*nfree;
+	*nbytes = *nblocks * sizeof(PyFloatBlock);
+	*nused = *nblocks * N_FLOATOBJECTS - *nfree;
+}
+
+void
+PyFloat_Fini(void)
+{
+	PyFloatObject *p;
+	PyFloatBlock *list;
+	unsigned i;
+	int bc, bf;	/* block count, number of freed blocks */
+	int fsum;	/* remaining unfreed floats */
+
+	bc = 0;
+	for (list = block_list; list != NULL; list = list->next)
+		bc++;
+	bf = PyFloat_CompactFreeList();
+	fsum = 0;
+	for (list = block_list; list != NULL; list = list->next)
+		fsum += block_used(list);
 	if (!Py_VerboseFlag)
 		return;
 	fprintf(stderr, "# cleanup floats");
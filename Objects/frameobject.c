@@ -402,6 +402,176 @@ static PyFrameObject *free_list = NULL;
 static int numfree = 0;		/* number of frames currently in free_list */
 #define MAXFREELIST 200		/* max value for numfree */
 
+/* Frames of code objects that are not generators cannot outlive the call
+   that created them unless something takes a reference to them (a
+   traceback, sys._getframe(), a gc.get_referrers() result...).  Those
+   frames are bump-allocated from a per-thread stack of memory chunks
+   instead of going through the free list and the GC allocator, so a deep
+   call chain touches one contiguous, cache-hot region.
+
+   Every frame sits in a slot laid out as
+
+	[frameslot][PyGC_Head][PyFrameObject + localsplus]
+
+   Slots are pushed and popped like native stack frames.  A frame that
+   escapes stays where it is: when it finally dies its slot is only marked
+   dead, and dead slots are reclaimed as soon as they reach the top of
+   their chunk again.  Generator frames are allocated on the heap as
+   before, since they are expected to outlive their creator.
+
+   A chunk whose thread state goes away while some of its frames are still
+   referenced is orphaned and freed when its last frame dies. */
+
+typedef union _frameslot {
+	struct {
+		struct _framechunk *chunk;	/* chunk holding this slot */
+		union _frameslot *below;	/* previous slot, or NULL */
+		int dead;			/* frame already deallocated */
+	} s;
+	long double dummy;  /* force worst-case alignment, like PyGC_Head */
+} frameslot;
+
+typedef struct _framechunk {
+	struct _framechunk *fc_previous;	/* older chunk, or NULL */
+	struct _framechunk *fc_next;		/* empty spare chunk, or NULL */
+	PyThreadState *fc_tstate;	/* owner, NULL once it is gone */
+	frameslot *fc_last;		/* topmost slot, or NULL */
+	char *fc_top;			/* first free byte */
+	char *fc_limit;			/* end of the chunk */
+	Py_ssize_t fc_live;		/* frames still alive in the chunk */
+} PyFrameChunk;
+
+#define FRAMECHUNK_SIZE (64 * 1024)
+#define FRAMECHUNK_START(c) \
+	((char *)(c) + _FRAME_ROUND_UP(sizeof(PyFrameChunk)))
+/* sizeof(frameslot) is not a power of two everywhere (12 bytes on i386,
+   where long double takes 12): round up by division, not by masking */
+#define _FRAME_ROUND_UP(n) \
+	(((n) + sizeof(frameslot) - 1) / sizeof(frameslot) * sizeof(frameslot))
+#define FRAME_SLOT(f) ((frameslot *)_Py_AS_GC(f) - 1)
+
+static PyFrameChunk *
+framestack_grow(PyThreadState *tstate, size_t needed)
+{
+	PyFrameChunk *cur = tstate->frame_chunk;
+	PyFrameChunk *chunk = NULL;
+	size_t size = FRAMECHUNK_SIZE;
+
+	if (needed + _FRAME_ROUND_UP(sizeof(PyFrameChunk)) > size)
+		size = needed + _FRAME_ROUND_UP(sizeof(PyFrameChunk));
+	if (cur != NULL && cur->fc_next != NULL) {
+		chunk = cur->fc_next;
+		if ((size_t)(chunk->fc_limit - FRAMECHUNK_START(chunk)) < needed) {
+			PyMem_FREE(chunk);
+			chunk = NULL;
+		}
+	}
+	if (chunk == NULL) {
+		chunk = (PyFrameChunk *)PyMem_MALLOC(size);
+		if (chunk == NULL)
+			return NULL;
+		chunk->fc_limit = (char *)chunk + size;
+	}
+	chunk->fc_previous = cur;
+	chunk->fc_next = NULL;
+	chunk->fc_tstate = tstate;
+	chunk->fc_last = NULL;
+	chunk->fc_top = FRAMECHUNK_START(chunk);
+	chunk->fc_live = 0;
+	if (cur != NULL)
+		cur->fc_next = chunk;
+	tstate->frame_chunk = chunk;
+	return chunk;
+}
+
+/* Carve an untracked frame with room for 'extras' slots out of the frame
+   stack of 'tstate'.  Returns NULL, without setting an exception, when no
+   memory is available; the caller then falls back to the heap. */
+static PyFrameObject *
+framestack_alloc(PyThreadState *tstate, Py_ssize_t extras)
+{
+	PyFrameChunk *chunk = tstate->frame_chunk;
+	frameslot *slot;
+	PyGC_Head *g;
+	PyFrameObject *f;
+	size_t size;
+
+	size = _FRAME_ROUND_UP(sizeof(frameslot) + sizeof(PyGC_Head) +
+			       _PyObject_VAR_SIZE(&PyFrame_Type, extras));
+	if (chunk == NULL || (size_t)(chunk->fc_limit - chunk->fc_top) < size) {
+		chunk = framestack_grow(tstate, size);
+		if (chunk == NULL)
+			return NULL;
+	}
+	slot = (frameslot *)chunk->fc_top;
+	chunk->fc_top += size;
+	slot->s.chunk = chunk;
+	slot->s.below = chunk->fc_last;
+	slot->s.dead = 0;
+	chunk->fc_last = slot;
+	chunk->fc_live++;
+
+	g = (PyGC_Head *)(slot + 1);
+	g->gc.gc_refs = _PyGC_REFS_UNTRACKED;
+	f = (PyFrameObject *)(g + 1);
+	(void)PyObject_INIT_VAR(f, &PyFrame_Type, extras);
+	f->f_onstack = 1;
+	return f;
+}
+
+static void
+framestack_release(PyFrameObject *f)
+{
+	frameslot *slot = FRAME_SLOT(f);
+	PyFrameChunk *chunk = slot->s.chunk;
+	PyThreadState *tstate = chunk->fc_tstate;
+
+	slot->s.dead = 1;
+	chunk->fc_live--;
+	if (tstate == NULL) {
+		/* Orphaned chunk: only waiting for its last frame. */
+		if (chunk->fc_live == 0)
+			PyMem_FREE(chunk);
+		return;
+	}
+	while (chunk->fc_last != NULL && chunk->fc_last->s.dead) {
+		chunk->fc_top = (char *)chunk->fc_last;
+		chunk->fc_last = chunk->fc_last->s.below;
+	}
+	if (chunk->fc_last == NULL && chunk == tstate->frame_chunk &&
+	    chunk->fc_previous != NULL) {
+		/* Step back down to the older chunk, keeping this one as its
+		   spare so that a call chain oscillating around the chunk
+		   boundary does not hit malloc() every time. */
+		if (chunk->fc_next != NULL) {
+			PyMem_FREE(chunk->fc_next);
+			chunk->fc_next = NULL;
+		}
+		tstate->frame_chunk = chunk->fc_previous;
+	}
+}
+
+void
+_PyFrame_ClearStack(PyThreadState *tstate)
+{
+	PyFrameChunk *chunk = tstate->frame_chunk;
+	PyFrameChunk *previous;
+
+	tstate->frame_chunk = NULL;
+	if (chunk == NULL)
+		return;
+	if (chunk->fc_next != NULL)
+		PyMem_FREE(chunk->fc_next);
+	while (chunk != NULL) {
+		previous = chunk->fc_previous;
+		if (chunk->fc_live == 0)
+			PyMem_FREE(chunk);
+		else
+			chunk->fc_tstate = NULL;
+		chunk = previous;
+	}
+}
+
 static void
 frame_dealloc(PyFrameObject *f)
 {
@@ -431,7 +601,9 @@ frame_dealloc(PyFrameObject *f)
 	Py_CLEAR(f->f_exc_traceback);
 
         co = f->f_code;
-        if (co->co_zombieframe == NULL)
+        if (f->f_onstack)
+                framestack_release(f);
+        else if (co->co_zombieframe == NULL)
                 co->co_zombieframe = f;
 	else if (numfree < MAXFREELIST) {
 		++numfree;
@@ -559,7 +731,7 @@ PyFrame_New(PyThreadState *tstate, PyCodeObject *code, PyObject *globals,
 	PyFrameObject *back = tstate->frame;
 	PyFrameObject *f;
 	PyObject *builtins;
-	Py_ssize_t i;
+	Py_ssize_t i, extras, ncells, nfrees;
 
 #ifdef Py_DEBUG
 	if (code == NULL || globals == NULL || !PyDict_Check(globals) ||
@@ -598,25 +770,29 @@ PyFrame_New(PyThreadState *tstate, PyCodeObject *code, PyObject *globals,
 		assert(builtins != NULL && PyDict_Check(builtins));
 		Py_INCREF(builtins);
 	}
-	if (code->co_zombieframe != NULL) {
+	ncells = PyTuple_GET_SIZE(code->co_cellvars);
+	nfrees = PyTuple_GET_SIZE(code->co_freevars);
+	extras = code->co_stacksize + code->co_nlocals + ncells + nfrees;
+	f = NULL;
+	if (!(code->co_flags & CO_GENERATOR))
+		f = framestack_alloc(tstate, extras);
+	if (f == NULL && code->co_zombieframe != NULL) {
                 f = code->co_zombieframe;
                 code->co_zombieframe = NULL;
                 _Py_NewReference((PyObject *)f);
                 assert(f->f_code == code);
 	}
         else {
-                Py_ssize_t extras, ncells, nfrees;
-                ncells = PyTuple_GET_SIZE(code->co_cellvars);
-                nfrees = PyTuple_GET_SIZE(code->co_freevars);
-                extras = code->co_stacksize + code->co_nlocals + ncells +
-                    nfrees;
-                if (free_list == NULL) {
+                if (f != NULL)
+                    ; /* fresh slot on the frame stack */
+                else if (free_list == NULL) {
                     f = PyObject_GC_NewVar(PyFrameObject, &PyFrame_Type,
                         extras);
                     if (f == NULL) {
                             Py_DECREF(builtins);
                             return NULL;
                     }
+                    f->f_onstack = 0;
                 }
                 else {
                     assert(numfree > 0);
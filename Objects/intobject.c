@@ -20,8 +20,9 @@ PyInt_GetMax(void)
    dedicated free list, filled when necessary with memory from malloc().
 
    block_list is a singly-linked list of all PyIntBlocks ever allocated,
-   linked via their next members.  PyIntBlocks are never returned to the
-   system before shutdown (PyInt_Fini).
+   linked via their next members.  PyIntBlocks are returned to the
+   system when they hold no live ints any more, by PyInt_CompactFreeList()
+   (called by full garbage collections) and at shutdown (PyInt_Fini).
 
    free_list is a singly-linked list of available PyIntObjects, linked
    via abuse of their ob_type members.
@@ -1173,49 +1174,42 @@ _PyInt_Init(void)
 		free_list = (PyIntObject *)v->ob_type;
 		PyObject_INIT(v, &PyInt_Type);
 		v->ob_ival = ival;
+		_Py_SetImmortal((PyObject *)v);
 		small_ints[ival + NSMALLNEGINTS] = v;
 	}
 #endif
 	return 1;
 }
 
-void
-PyInt_Fini(void)
+/* Number of live ints in a block */
+static int
+block_used(PyIntBlock *list)
 {
 	PyIntObject *p;
-	PyIntBlock *list, *next;
-	int i;
 	unsigned int ctr;
-	int bc, bf;	/* block count, number of freed blocks */
-	int irem, isum;	/* remaining unfreed ints per block, total */
+	int used = 0;
 
-#if NSMALLNEGINTS + NSMALLPOSINTS > 0
-        PyIntObject **q;
+	for (ctr = 0, p = &list->objects[0]; ctr < N_INTOBJECTS; ctr++, p++) {
+		if (PyInt_CheckExact(p) && p->ob_refcnt != 0)
+			used++;
+	}
+	return used;
+}
+
+int
+PyInt_CompactFreeList(void)
+{
+	PyIntObject *p;
+	PyIntBlock *list, *next;
+	unsigned int ctr;
+	int freed = 0;
 
-        i = NSMALLNEGINTS + NSMALLPOSINTS;
-        q = small_ints;
-        while (--i >= 0) {
-                Py_XDECREF(*q);
-                *q++ = NULL;
-        }
-#endif
-	bc = 0;
-	bf = 0;
-	isum = 0;
 	list = block_list;
 	block_list = NULL;
 	free_list = NULL;
 	while (list != NULL) {
-		bc++;
-		irem = 0;
-		for (ctr = 0, p = &list->objects[0];
-		     ctr < N_INTOBJECTS;
-		     ctr++, p++) {
-			if (PyInt_CheckExact(p) && p->ob_refcnt != 0)
-				irem++;
-		}
 		next = list->next;
-		if (irem) {
+		if (block_used(list)) {
 			list->next = block_list;
 			block_list = list;
 			for (ctr = 0, p = &list->objects[0];
@@ -1227,25 +1221,78 @@ PyInt_Fini(void)
 						free_list;
 					free_list = p;
 				}
-#if NSMALLNEGINTS + NSMALLPOSINTS > 0
-				else if (-NSMALLNEGINTS <= p->ob_ival &&
-					 p->ob_ival < NSMALLPOSINTS &&
-					 small_ints[p->ob_ival +
-						    NSMALLNEGINTS] == NULL) {
-					Py_INCREF(p);
-					small_ints[p->ob_ival +
-						   NSMALLNEGINTS] = p;
-				}
-#endif
 			}
 		}
 		else {
 			PyMem_FREE(list);
-			bf++;
+			freed++;
 		}
-		isum += irem;
 		list = next;
 	}
+	return freed;
+}
+
+void
+PyInt_GetFreeListStats(Py_ssize_t *nblocks, Py_ssize_t *nbytes,
+		       Py_ssize_t *nused, Py_ssize_t *nfree)
+{
+	PyIntBlock *list;
+	PyIntObject *p;
+
+	*nblocks = 0;
+	for (list = block_list; list != NULL; list = list->next)
+		++*nblocks;
+	*nfree = 0;
+	for (p = free_list; p != NULL; p = (PyIntObject *)p->ob_type)
+		++*nfree;
+	*nbytes = *nblocks * sizeof(PyIntBlock);
+	*nused = *nblocks * N_INTOBJECTS - *nfree;
+}
+
+void
+PyInt_Fini(void)
+{
+	PyIntObject *p;
+	PyIntBlock *list;
+	int i;
+	unsigned int ctr;
+	int bc, bf;	/* block count, number of freed blocks */
+	int isum;	/* remaining unfreed ints */
+
+#if NSMALLNEGINTS + NSMALLPOSINTS > 0
+        PyIntObject **q;
+
+        i = NSMALLNEGINTS + NSMALLPOSINTS;
+        q = small_ints;
+        while (--i >= 0) {
+                Py_XDECREF(*q);
+                *q++ = NULL;
+        }
+#endif
+	bc = 0;
+	for (list = block_list; list != NULL; list = list->next)
+		bc++;
+	bf = PyInt_CompactFreeList();
+	isum = 0;
+	for (list = block_list; list != NULL; list = list->next) {
+		isum += block_used(list);
+#if NSMALLNEGINTS + NSMALLPOSINTS > 0
+		for (ctr = 0, p = &list->objects[0];
+		     ctr < N_INTOBJECTS;
+		     ctr++, p++) {
+			if (PyInt_CheckExact(p) && p->ob_refcnt != 0 &&
+			    -NSMALLNEGINTS <= p->ob_ival &&
+			    p->ob_ival < NSMALLPOSINTS &&
+			    small_ints[p->ob_ival + NSMALLNEGINTS] == NULL) {
+				Py_INCREF(p);
+				small_ints[p->ob_ival + NSMALLNEGINTS] = p;
+				/* immortal, not leaked */
+				if (_Py_IsImmortal(p))
+					isum--;
+			}
+		}
+#endif
+	}
 	if (!Py_VerboseFlag)
 		return;
 	fprintf(stderr, "# cleanup ints");
@@ -1264,7 +1311,8 @@ PyInt_Fini(void)
 			for (ctr = 0, p = &list->objects[0];
 			     ctr < N_INTOBJECTS;
 			     ctr++, p++) {
-				if (PyInt_CheckExact(p) && p->ob_refcnt != 0)
+				if (PyInt_CheckExact(p) && p->ob_refcnt != 0 &&
+				    !_Py_IsImmortal(p))
 					/* XXX(twouters) cast refcount to
 					   long until %zd is universally
 					   available
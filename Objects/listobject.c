@@ -256,6 +256,36 @@ PyList_Append(PyObject *op, PyObject *newitem)
 	return -1;
 }
 
+/* Make room for n items without changing the size of the list, so
+   that storing up to n items in ob_item[ob_size] and incrementing
+   ob_size needs no resize.  Unlike list_resize(), this never
+   over-allocates. */
+int
+_PyList_Reserve(PyObject *op, Py_ssize_t n)
+{
+	PyListObject *self = (PyListObject *)op;
+	PyObject **items;
+
+	if (!PyList_Check(op)) {
+		PyErr_BadInternalCall();
+		return -1;
+	}
+	if (n <= self->allocated)
+		return 0;
+	items = self->ob_item;
+	if ((size_t)n <= ((~(size_t)0) / sizeof(PyObject *)))
+		PyMem_RESIZE(items, PyObject *, n);
+	else
+		items = NULL;
+	if (items == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+	self->ob_item = items;
+	self->allocated = n;
+	return 0;
+}
+
 /* Methods */
 
 static void
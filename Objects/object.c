@@ -19,10 +19,10 @@ _Py_GetRefTotal(void)
            because they are not reliable and not useful (now that the
            hash table code is well-tested) */
 	o = _PyDict_Dummy();
-	if (o != NULL)
+	if (o != NULL && !_Py_IsImmortal(o))
 		total -= o->ob_refcnt;
 	o = _PySet_Dummy();
-	if (o != NULL)
+	if (o != NULL && !_Py_IsImmortal(o))
 		total -= o->ob_refcnt;
 	return total;
 }
@@ -207,6 +207,18 @@ Py_DecRef(PyObject *o)
     Py_XDECREF(o);
 }
 
+void
+_Py_SetImmortal(PyObject *op)
+{
+	if (_Py_IsImmortal(op))
+		return;
+#ifdef Py_REF_DEBUG
+	/* references to op are no longer counted */
+	_Py_RefTotal -= op->ob_refcnt;
+#endif
+	op->ob_refcnt = _Py_IMMORTAL_REFCNT;
+}
+
 PyObject *
 PyObject_Init(PyObject *op, PyTypeObject *tp)
 {
@@ -1367,6 +1379,57 @@ PyObject_GenericGetAttr(PyObject *obj, PyObject *name)
 	return res;
 }
 
+/* Look up the attribute name of obj for an immediate call, as done by
+   the LOAD_METHOD opcode.  If it is a method that PyObject_GetAttr()
+   would bind to obj (a function or method descriptor found on the
+   type, or a function of the class of a classic instance), return 1 and
+   store a new reference to the unbound method in *method.  Otherwise
+   return 0 and store the result of PyObject_GetAttr() in *method, which
+   is NULL if an exception was raised. */
+int
+_PyObject_GetMethod(PyObject *obj, PyObject *name, PyObject **method)
+{
+	PyTypeObject *tp = obj->ob_type;
+	PyObject *descr, *attr;
+	PyObject **dictptr;
+
+	if (!PyString_CheckExact(name))
+		goto generic;
+	if (PyInstance_Check(obj)) {
+		*method = _PyInstance_GetMethod(obj, name);
+		if (*method != NULL)
+			return 1;
+		goto generic;
+	}
+	if (tp->tp_getattro != PyObject_GenericGetAttr)
+		goto generic;
+	if (tp->tp_dict == NULL && PyType_Ready(tp) < 0) {
+		*method = NULL;
+		return 0;
+	}
+	descr = _PyType_Lookup(tp, name);
+	if (descr == NULL ||
+	    !(PyFunction_Check(descr) || PyMethodDescr_Check(descr)))
+		goto generic;
+	/* An instance attribute would shadow the method. */
+	dictptr = _PyObject_GetDictPtr(obj);
+	if (dictptr != NULL && *dictptr != NULL) {
+		attr = PyDict_GetItem(*dictptr, name);
+		if (attr != NULL) {
+			Py_INCREF(attr);
+			*method = attr;
+			return 0;
+		}
+	}
+	Py_INCREF(descr);
+	*method = descr;
+	return 1;
+
+  generic:
+	*method = PyObject_GetAttr(obj, name);
+	return 0;
+}
+
 int
 PyObject_GenericSetAttr(PyObject *obj, PyObject *name, PyObject *value)
 {
@@ -1,7 +1,20 @@
 #include "Python.h"
+#include "frameobject.h"
 
 #ifdef WITH_PYMALLOC
 
+#if !defined(MS_WINDOWS) && defined(HAVE_UNISTD_H) && defined(HAVE_LONG_LONG)
+#include <sys/mman.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+#if defined(MAP_ANONYMOUS) && defined(MADV_DONTNEED)
+/* Map arenas with mmap and give unused memory back with madvise, see
+ * arena_map() */
+#define ARENAS_USE_MMAP
+#endif
+#endif
+
 /* An object allocator for Python.
 
    Here is an introduction to the layers of the Python memory architecture,
@@ -167,7 +180,8 @@
  *
  * Therefore, allocating arenas with malloc is not optimal, because there is
  * some address space wastage, but this is the most portable way to request
- * memory from the system across various platforms.
+ * memory from the system across various platforms.  Where mmap is
+ * available (ARENAS_USE_MMAP) arenas are mapped directly instead.
  */
 #define ARENA_SIZE		(256 << 10)	/* 256KB */
 
@@ -285,6 +299,18 @@ struct arena_object {
 	 */
 	struct arena_object* nextarena;
 	struct arena_object* prevarena;
+
+#ifdef ARENAS_USE_MMAP
+	/* The chunk the arena was carved from, see arena_map(). */
+	uint chunkindex;
+
+	/* Bit i is set if the i-th pool of the arena is free and its memory
+	 * was given back to the system by _PyObject_ReleaseFreePools().
+	 * These pools are counted in nfreepools, but are neither on the
+	 * freepools list nor beyond pool_address.
+	 */
+	unsigned PY_LONG_LONG decommitted;
+#endif
 };
 
 #undef  ROUNDUP
@@ -492,14 +518,199 @@ static struct arena_object* usable_arenas = NULL;
 
 /* Number of arenas allocated that haven't been free()'d. */
 static size_t narenas_currently_allocated = 0;
+/* High water mark (max value ever seen) for narenas_currently_allocated. */
+static size_t narenas_highwater = 0;
 
 #ifdef PYMALLOC_DEBUG
 /* Total number of times malloc() called to allocate an arena. */
 static size_t ntimes_arena_allocated = 0;
-/* High water mark (max value ever seen) for narenas_currently_allocated. */
-static size_t narenas_highwater = 0;
 #endif
 
+/*
+ * Counters kept in release builds too, see _PyObject_GetMallocStats():
+ * the bytes asked of PyObject_Malloc(), the number of blocks handed out
+ * from each size class, and the requests passed on to malloc().
+ */
+static size_t requested_bytes = 0;
+static size_t class_allocs[NB_SMALL_SIZE_CLASSES];
+static size_t large_allocs = 0;
+static size_t large_bytes = 0;
+
+/*
+ * Allocation sampling, see _PyObject_SetMallocSampling(): once
+ * requested_bytes reaches next_sample, the Python stack of the
+ * allocating thread is recorded and next_sample moves on by
+ * sample_interval.  The samples live in memory from malloc() and hold
+ * references to the code objects of their frames; turning them into
+ * Python objects is left to _PyObject_TakeMallocSamples(), as nothing
+ * must be allocated from PyObject_Malloc() itself.
+ */
+#define MAX_SAMPLE_DEPTH	32	/* innermost frames recorded */
+#define MAX_SAMPLES		1024	/* kept until taken */
+
+struct malloc_sample {
+	size_t nbytes;		/* requested bytes the sample stands for */
+	int depth;
+	PyCodeObject *code[MAX_SAMPLE_DEPTH];	/* innermost first */
+	int lasti[MAX_SAMPLE_DEPTH];
+};
+
+static size_t next_sample = (size_t)-1;	/* never, while not sampling */
+static size_t sample_interval = 0;
+static struct malloc_sample *samples = NULL;
+static int nsamples = 0;
+static size_t ndropped_samples = 0;
+
+#ifdef ARENAS_USE_MMAP
+/*
+ * Arenas are carved from chunks of ARENAS_PER_CHUNK arenas, mapped
+ * aligned to their size.  Every pool of an arena is then usable, and a
+ * chunk can be backed by a transparent huge page, which saves TLB misses
+ * on large heaps.  The memory of an arena that is freed goes back to the
+ * system with madvise(MADV_DONTNEED), and a chunk is unmapped once none
+ * of its arenas is in use.  Free pools of arenas in use are given back
+ * the same way by _PyObject_ReleaseFreePools().
+ *
+ * Settings, read from the environment when the first arena is mapped:
+ *
+ * PYTHONMALLOCHUGEPAGES	if non-empty, madvise(MADV_HUGEPAGE) chunks
+ * PYTHONMALLOCKEEPPOOLS	if non-empty, keep free pools mapped
+ */
+#define CHUNK_SIZE		(2 << 20)	/* 2MB, an x86 huge page */
+#define CHUNK_SIZE_MASK		(CHUNK_SIZE - 1)
+#define ARENAS_PER_CHUNK	(CHUNK_SIZE / ARENA_SIZE)
+#define ALL_ARENAS_USED		((1U << ARENAS_PER_CHUNK) - 1)
+
+struct arena_chunk {
+	uptr address;	/* 0 if the chunk isn't mapped */
+	uint used;	/* bit i is set if the i-th arena is in use */
+};
+
+static struct arena_chunk *chunks = NULL;
+static uint maxchunks = 0;
+
+static int use_hugepages = -1;	/* -1 until the settings are read */
+static int keep_free_pools = 0;
+
+static void
+read_arena_settings(void)
+{
+	char *p;
+
+	p = Py_GETENV("PYTHONMALLOCHUGEPAGES");
+	use_hugepages = p != NULL && *p != '\0';
+	p = Py_GETENV("PYTHONMALLOCKEEPPOOLS");
+	keep_free_pools = p != NULL && *p != '\0';
+}
+
+/* Map a chunk aligned to CHUNK_SIZE.  Return its address, or 0. */
+static uptr
+map_chunk(void)
+{
+	void *p;
+	uptr address;
+	size_t head;
+
+	/* Map twice the size and trim it to the aligned chunk inside. */
+	p = mmap(NULL, 2 * CHUNK_SIZE, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return 0;
+	address = (uptr)p;
+	head = (CHUNK_SIZE - (size_t)(address & CHUNK_SIZE_MASK)) &
+		CHUNK_SIZE_MASK;
+	if (head != 0)
+		munmap(p, head);
+	munmap((void *)(address + head + CHUNK_SIZE), CHUNK_SIZE - head);
+	address += head;
+#ifdef MADV_HUGEPAGE
+	if (use_hugepages)
+		(void)madvise((void *)address, CHUNK_SIZE, MADV_HUGEPAGE);
+#endif
+	return address;
+}
+
+/* Take an arena from a chunk, mapping a new chunk if they are all in
+ * use.  Return its address, or 0.
+ */
+static uptr
+arena_map(uint *chunkindex)
+{
+	struct arena_chunk *c;
+	uint i, j;
+	uint unmapped = maxchunks;
+
+	if (use_hugepages < 0)
+		read_arena_settings();
+	for (i = 0; i < maxchunks; ++i) {
+		if (chunks[i].address == 0) {
+			if (unmapped == maxchunks)
+				unmapped = i;
+		}
+		else if (chunks[i].used != ALL_ARENAS_USED)
+			break;
+	}
+	if (i == maxchunks) {
+		i = unmapped;
+		if (i == maxchunks) {
+			uint numchunks = maxchunks ? maxchunks << 1 : 16;
+			if (numchunks <= maxchunks ||
+			    numchunks > PY_SIZE_MAX / sizeof(*chunks))
+				return 0;	/* overflow */
+			c = (struct arena_chunk *)realloc(chunks,
+					numchunks * sizeof(*chunks));
+			if (c == NULL)
+				return 0;
+			chunks = c;
+			for (j = maxchunks; j < numchunks; ++j)
+				chunks[j].address = 0;
+			maxchunks = numchunks;
+		}
+		chunks[i].address = map_chunk();
+		if (chunks[i].address == 0)
+			return 0;
+		chunks[i].used = 0;
+	}
+	c = &chunks[i];
+	for (j = 0; c->used & (1U << j); ++j)
+		;
+	c->used |= 1U << j;
+	*chunkindex = i;
+	return c->address + j * ARENA_SIZE;
+}
+
+/* Give the memory of a free arena back to the system. */
+static void
+arena_unmap(uptr address, uint chunkindex)
+{
+	struct arena_chunk *c = &chunks[chunkindex];
+
+	c->used &= ~(1U << ((address - c->address) / ARENA_SIZE));
+	if (c->used == 0) {
+		munmap((void *)c->address, CHUNK_SIZE);
+		c->address = 0;
+	}
+	else
+		(void)madvise((void *)address, ARENA_SIZE, MADV_DONTNEED);
+}
+
+#define POOL_BIT(AO, POOL) \
+	((unsigned PY_LONG_LONG)1 << (((uptr)(POOL) - (AO)->address) / POOL_SIZE))
+
+/* Take a decommitted pool of the arena; touching it maps it again. */
+static poolp
+take_decommitted_pool(struct arena_object *ao)
+{
+	uint j;
+
+	assert(ao->decommitted != 0);
+	for (j = 0; !(ao->decommitted & ((unsigned PY_LONG_LONG)1 << j)); ++j)
+		;
+	ao->decommitted &= ~((unsigned PY_LONG_LONG)1 << j);
+	return (poolp)(ao->address + j * POOL_SIZE);
+}
+#endif /* ARENAS_USE_MMAP */
+
 /* Allocate a new arena.  If we run out of memory, return NULL.  Else
  * allocate a new arena, and return the address of an arena_object
  * describing the new arena.  It's expected that the caller will set
@@ -560,7 +771,12 @@ new_arena(void)
 	arenaobj = unused_arena_objects;
 	unused_arena_objects = arenaobj->nextarena;
 	assert(arenaobj->address == 0);
+#ifdef ARENAS_USE_MMAP
+	arenaobj->address = arena_map(&arenaobj->chunkindex);
+	arenaobj->decommitted = 0;
+#else
 	arenaobj->address = (uptr)malloc(ARENA_SIZE);
+#endif
 	if (arenaobj->address == 0) {
 		/* The allocation failed: return NULL after putting the
 		 * arenaobj back.
@@ -571,10 +787,10 @@ new_arena(void)
 	}
 
 	++narenas_currently_allocated;
-#ifdef PYMALLOC_DEBUG
-	++ntimes_arena_allocated;
 	if (narenas_currently_allocated > narenas_highwater)
 		narenas_highwater = narenas_currently_allocated;
+#ifdef PYMALLOC_DEBUG
+	++ntimes_arena_allocated;
 #endif
 	arenaobj->freepools = NULL;
 	/* pool_address <- first pool-aligned address in the arena
@@ -709,6 +925,42 @@ int Py_ADDRESS_IN_RANGE(void *P, poolp pool) Py_NO_INLINE;
  * from all other currently live pointers.  This may not be possible.
  */
 
+/* Record the stack of the running thread, for the allocation that took
+ * requested_bytes to next_sample or beyond.
+ */
+static void
+sample_allocation(void)
+{
+	PyThreadState *tstate = _PyThreadState_Current;
+	struct malloc_sample *sample;
+	PyFrameObject *f;
+	size_t nbytes;
+	int depth = 0;
+
+	/* not sampling: requested_bytes merely reached (size_t)-1 */
+	if (sample_interval == 0)
+		return;
+	/* a large request stands for every interval it spans */
+	nbytes = ((requested_bytes - next_sample) / sample_interval + 1) *
+		sample_interval;
+	next_sample += nbytes;
+	if (tstate == NULL || tstate->frame == NULL)
+		return;
+	if (nsamples == MAX_SAMPLES) {
+		++ndropped_samples;
+		return;
+	}
+	sample = &samples[nsamples++];
+	sample->nbytes = nbytes;
+	for (f = tstate->frame; f != NULL && depth < MAX_SAMPLE_DEPTH;
+	     f = f->f_back, ++depth) {
+		Py_INCREF(f->f_code);
+		sample->code[depth] = f->f_code;
+		sample->lasti[depth] = f->f_lasti;
+	}
+	sample->depth = depth;
+}
+
 /*
  * The basic blocks are ordered by decreasing execution frequency,
  * which minimizes the number of jumps in the most common cases,
@@ -726,6 +978,10 @@ PyObject_Malloc(size_t nbytes)
 	poolp next;
 	uint size;
 
+	requested_bytes += nbytes;
+	if (requested_bytes >= next_sample)
+		sample_allocation();
+
 	/*
 	 * This implicitly redirects malloc(0).
 	 */
@@ -735,6 +991,7 @@ PyObject_Malloc(size_t nbytes)
 		 * Most frequent paths first
 		 */
 		size = (uint)(nbytes - 1) >> ALIGNMENT_SHIFT;
+		++class_allocs[size];
 		pool = usedpools[size + size];
 		if (pool != pool->nextpool) {
 			/*
@@ -824,6 +1081,9 @@ PyObject_Malloc(size_t nbytes)
 				 * time.
 				 */
 				assert(usable_arenas->freepools != NULL ||
+#ifdef ARENAS_USE_MMAP
+				       usable_arenas->decommitted != 0 ||
+#endif
 				       usable_arenas->pool_address <=
 				           (block*)usable_arenas->address +
 				               ARENA_SIZE - POOL_SIZE);
@@ -865,13 +1125,20 @@ PyObject_Malloc(size_t nbytes)
 		/* Carve off a new pool. */
 		assert(usable_arenas->nfreepools > 0);
 		assert(usable_arenas->freepools == NULL);
-		pool = (poolp)usable_arenas->pool_address;
+#ifdef ARENAS_USE_MMAP
+		if (usable_arenas->decommitted != 0)
+			pool = take_decommitted_pool(usable_arenas);
+		else
+#endif
+		{
+			pool = (poolp)usable_arenas->pool_address;
+			usable_arenas->pool_address += POOL_SIZE;
+		}
 		assert((block*)pool <= (block*)usable_arenas->address +
 		                       ARENA_SIZE - POOL_SIZE);
 		pool->arenaindex = usable_arenas - arenas;
 		assert(&arenas[pool->arenaindex] == usable_arenas);
 		pool->szidx = DUMMY_SIZE_IDX;
-		usable_arenas->pool_address += POOL_SIZE;
 		--usable_arenas->nfreepools;
 
 		if (usable_arenas->nfreepools == 0) {
@@ -899,6 +1166,8 @@ redirect:
 	 */
 	if (nbytes == 0)
 		nbytes = 1;
+	++large_allocs;
+	large_bytes += nbytes;
 	return (void *)malloc(nbytes);
 }
 
@@ -1005,7 +1274,11 @@ PyObject_Free(void *p)
 				unused_arena_objects = ao;
 
 				/* Free the entire arena. */
+#ifdef ARENAS_USE_MMAP
+				arena_unmap(ao->address, ao->chunkindex);
+#else
 				free((void *)ao->address);
+#endif
 				ao->address = 0;	/* mark unassociated */
 				--narenas_currently_allocated;
 
@@ -1179,6 +1452,229 @@ PyObject_Realloc(void *p, size_t nbytes)
    	return bp ? bp : p;
 }
 
+/* Give the memory of the free pools of all arenas back to the system;
+ * they stay reserved for the arena and are reused like any free pool.
+ * Returns the number of pools released.
+ */
+Py_ssize_t
+_PyObject_ReleaseFreePools(void)
+{
+	Py_ssize_t n = 0;
+#ifdef ARENAS_USE_MMAP
+	struct arena_object *ao;
+	poolp pool;
+	uint i;
+
+	if (use_hugepages < 0)
+		read_arena_settings();
+	if (keep_free_pools)
+		return 0;
+	LOCK();
+	for (i = 0; i < maxarenas; ++i) {
+		ao = &arenas[i];
+		if (ao->address == 0)
+			continue;
+		while ((pool = ao->freepools) != NULL) {
+			ao->freepools = pool->nextpool;
+			ao->decommitted |= POOL_BIT(ao, pool);
+			(void)madvise((void *)pool, POOL_SIZE, MADV_DONTNEED);
+			++n;
+		}
+	}
+	UNLOCK();
+#endif
+	return n;
+}
+
+/* Build a dict of the allocator counters: the arenas in use and their
+ * high water mark, the free pools and those of them released by
+ * _PyObject_ReleaseFreePools(), the bytes asked of PyObject_Malloc()
+ * and the bytes handed out for them (block sizes are rounded up, and
+ * requests above the small block threshold go to malloc()), and for
+ * each size class a tuple (block size, pools, blocks in use, free
+ * blocks in used pools, blocks ever allocated).
+ */
+PyObject *
+_PyObject_GetMallocStats(void)
+{
+	size_t numpools[NB_SMALL_SIZE_CLASSES];
+	size_t numblocks[NB_SMALL_SIZE_CLASSES];
+	size_t numfreeblocks[NB_SMALL_SIZE_CLASSES];
+	size_t allocs[NB_SMALL_SIZE_CLASSES];
+	size_t numfreepools = 0;
+	size_t numreleased = 0;
+	size_t allocated_bytes = large_bytes;
+	size_t used_bytes = 0;
+	PyObject *result, *classes = NULL, *item;
+	uint i, j;
+
+	/* take the numbers first: building the result allocates */
+	for (i = 0; i < NB_SMALL_SIZE_CLASSES; ++i) {
+		numpools[i] = numblocks[i] = numfreeblocks[i] = 0;
+		allocs[i] = class_allocs[i];
+		allocated_bytes += allocs[i] * INDEX2SIZE(i);
+	}
+	for (i = 0; i < maxarenas; ++i) {
+		uptr base = arenas[i].address;
+
+		if (base == (uptr)NULL)
+			continue;
+		numfreepools += arenas[i].nfreepools;
+#ifdef ARENAS_USE_MMAP
+		{
+			unsigned PY_LONG_LONG bits;
+			for (bits = arenas[i].decommitted; bits; bits &= bits - 1)
+				++numreleased;
+		}
+#endif
+		if (base & (uptr)POOL_SIZE_MASK) {
+			base &= ~(uptr)POOL_SIZE_MASK;
+			base += POOL_SIZE;
+		}
+		for (j = 0; base < (uptr) arenas[i].pool_address;
+		     ++j, base += POOL_SIZE) {
+			poolp p = (poolp)base;
+			const uint sz = p->szidx;
+
+#ifdef ARENAS_USE_MMAP
+			if (arenas[i].decommitted & POOL_BIT(&arenas[i], p))
+				continue;
+#endif
+			if (p->ref.count == 0)
+				continue;
+			++numpools[sz];
+			numblocks[sz] += p->ref.count;
+			numfreeblocks[sz] += NUMBLOCKS(sz) - p->ref.count;
+			used_bytes += p->ref.count * INDEX2SIZE(sz);
+		}
+	}
+
+	result = Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:n,s:N,s:N,s:N,s:N,s:N,s:n}",
+		"arenas", (Py_ssize_t)narenas_currently_allocated,
+		"arenas_highwater", (Py_ssize_t)narenas_highwater,
+		"arena_size", (Py_ssize_t)ARENA_SIZE,
+		"pool_size", (Py_ssize_t)POOL_SIZE,
+		"free_pools", (Py_ssize_t)numfreepools,
+		"released_pools", (Py_ssize_t)numreleased,
+		"requested_bytes", PyInt_FromSize_t(requested_bytes),
+		"allocated_bytes", PyInt_FromSize_t(allocated_bytes),
+		"bytes_in_use", PyInt_FromSize_t(used_bytes),
+		"large_allocations", PyInt_FromSize_t(large_allocs),
+		"large_bytes", PyInt_FromSize_t(large_bytes),
+		"dropped_samples", (Py_ssize_t)ndropped_samples);
+	if (result == NULL)
+		return NULL;
+	classes = PyList_New(NB_SMALL_SIZE_CLASSES);
+	if (classes == NULL)
+		goto error;
+	for (i = 0; i < NB_SMALL_SIZE_CLASSES; ++i) {
+		item = Py_BuildValue("(nnnnN)", (Py_ssize_t)INDEX2SIZE(i),
+				     (Py_ssize_t)numpools[i],
+				     (Py_ssize_t)numblocks[i],
+				     (Py_ssize_t)numfreeblocks[i],
+				     PyInt_FromSize_t(allocs[i]));
+		if (item == NULL)
+			goto error;
+		PyList_SET_ITEM(classes, i, item);
+	}
+	if (PyDict_SetItemString(result, "classes", classes) < 0)
+		goto error;
+	Py_DECREF(classes);
+	return result;
+
+  error:
+	Py_XDECREF(classes);
+	Py_DECREF(result);
+	return NULL;
+}
+
+/* Record the Python stack of the running thread about every interval
+ * bytes requested from PyObject_Malloc(); 0 stops.  Returns -1 with
+ * MemoryError set if there is no room for the samples.
+ */
+int
+_PyObject_SetMallocSampling(size_t interval)
+{
+	if (interval == 0) {
+		next_sample = (size_t)-1;
+		sample_interval = 0;
+		return 0;
+	}
+	if (samples == NULL) {
+		samples = (struct malloc_sample *)
+			malloc(MAX_SAMPLES * sizeof(struct malloc_sample));
+		if (samples == NULL) {
+			PyErr_NoMemory();
+			return -1;
+		}
+	}
+	sample_interval = interval;
+	next_sample = requested_bytes + interval;
+	return 0;
+}
+
+/* Return the samples recorded so far as a dict, and start afresh.  Each
+ * stack is a tuple of (filename, lineno, function name) for each frame,
+ * outermost first, mapped to the number of bytes its samples stand for.
+ * Only the MAX_SAMPLE_DEPTH innermost frames are kept, and samples past
+ * MAX_SAMPLES are dropped, and counted, until the next call.
+ */
+PyObject *
+_PyObject_TakeMallocSamples(void)
+{
+	PyObject *result, *stack = NULL, *entry, *total;
+	struct malloc_sample *sample;
+	PyCodeObject *co;
+	size_t nbytes;
+	int i, j;
+
+	/* what is allocated here is not worth a sample */
+	next_sample = (size_t)-1;
+	result = PyDict_New();
+	if (result == NULL)
+		goto done;
+	for (i = 0; i < nsamples; ++i) {
+		sample = &samples[i];
+		stack = PyTuple_New(sample->depth);
+		if (stack == NULL)
+			goto error;
+		for (j = 0; j < sample->depth; ++j) {
+			co = sample->code[j];
+			entry = Py_BuildValue("(OiO)", co->co_filename,
+				PyCode_Addr2Line(co, sample->lasti[j]),
+				co->co_name);
+			if (entry == NULL)
+				goto error;
+			PyTuple_SET_ITEM(stack, sample->depth - 1 - j, entry);
+		}
+		nbytes = sample->nbytes;
+		total = PyDict_GetItem(result, stack);
+		if (total != NULL)
+			nbytes += (size_t)PyInt_AsSsize_t(total);
+		total = PyInt_FromSize_t(nbytes);
+		if (total == NULL || PyDict_SetItem(result, stack, total) < 0) {
+			Py_XDECREF(total);
+			goto error;
+		}
+		Py_DECREF(total);
+		Py_CLEAR(stack);
+	}
+	for (i = 0; i < nsamples; ++i)
+		for (j = 0; j < samples[i].depth; ++j)
+			Py_DECREF(samples[i].code[j]);
+	nsamples = 0;
+	ndropped_samples = 0;
+	goto done;
+
+  error:
+	Py_XDECREF(stack);
+	Py_CLEAR(result);
+  done:
+	if (sample_interval != 0)
+		next_sample = requested_bytes + sample_interval;
+	return result;
+}
+
 #else	/* ! WITH_PYMALLOC */
 
 /*==========================================================================*/
@@ -1202,6 +1698,39 @@ PyObject_Free(void *p)
 {
 	PyMem_FREE(p);
 }
+
+Py_ssize_t
+_PyObject_ReleaseFreePools(void)
+{
+	return 0;
+}
+
+static PyObject *
+no_pymalloc(void)
+{
+	PyErr_SetString(PyExc_NotImplementedError,
+			"Python was built without pymalloc");
+	return NULL;
+}
+
+PyObject *
+_PyObject_GetMallocStats(void)
+{
+	return no_pymalloc();
+}
+
+int
+_PyObject_SetMallocSampling(size_t interval)
+{
+	(void)no_pymalloc();
+	return -1;
+}
+
+PyObject *
+_PyObject_TakeMallocSamples(void)
+{
+	return no_pymalloc();
+}
 #endif /* WITH_PYMALLOC */
 
 #ifdef PYMALLOC_DEBUG
@@ -1660,6 +2189,10 @@ _PyObject_DebugMallocStats(void)
 			const uint sz = p->szidx;
 			uint freeblocks;
 
+#ifdef ARENAS_USE_MMAP
+			if (arenas[i].decommitted & POOL_BIT(&arenas[i], p))
+				continue;
+#endif
 			if (p->ref.count == 0) {
 				/* currently unused */
 				assert(pool_is_in_list(p, arenas[i].freepools));
@@ -87,13 +87,13 @@ PyString_FromStringAndSize(const char *str, Py_ssize_t size)
 		PyString_InternInPlace(&t);
 		op = (PyStringObject *)t;
 		nullstring = op;
-		Py_INCREF(op);
+		_Py_SetImmortal((PyObject *)op);
 	} else if (size == 1 && str != NULL) {
 		PyObject *t = (PyObject *)op;
 		PyString_InternInPlace(&t);
 		op = (PyStringObject *)t;
 		characters[*str & UCHAR_MAX] = op;
-		Py_INCREF(op);
+		_Py_SetImmortal((PyObject *)op);
 	}
 	return (PyObject *) op;
 }
@@ -140,13 +140,13 @@ PyString_FromString(const char *str)
 		PyString_InternInPlace(&t);
 		op = (PyStringObject *)t;
 		nullstring = op;
-		Py_INCREF(op);
+		_Py_SetImmortal((PyObject *)op);
 	} else if (size == 1) {
 		PyObject *t = (PyObject *)op;
 		PyString_InternInPlace(&t);
 		op = (PyStringObject *)t;
 		characters[*str & UCHAR_MAX] = op;
-		Py_INCREF(op);
+		_Py_SetImmortal((PyObject *)op);
 	}
 	return (PyObject *) op;
 }
@@ -4958,7 +4958,22 @@ PyString_InternImmortal(PyObject **p)
 	PyString_InternInPlace(p);
 	if (PyString_CHECK_INTERNED(*p) != SSTATE_INTERNED_IMMORTAL) {
 		PyString_CHECK_INTERNED(*p) = SSTATE_INTERNED_IMMORTAL;
-		Py_INCREF(*p);
+		_Py_SetImmortal(*p);
+	}
+}
+
+/* Make all the strings interned so far immortal */
+void
+_PyString_ImmortalizeInterned(void)
+{
+	PyObject *s, *value;
+	Py_ssize_t pos = 0;
+
+	if (interned == NULL)
+		return;
+	while (PyDict_Next(interned, &pos, &s, &value)) {
+		PyString_CHECK_INTERNED(s) = SSTATE_INTERNED_IMMORTAL;
+		_Py_SetImmortal(s);
 	}
 }
 
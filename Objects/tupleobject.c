@@ -75,7 +75,7 @@ PyTuple_New(register Py_ssize_t size)
 	if (size == 0) {
 		free_tuples[0] = op;
 		++num_free_tuples[0];
-		Py_INCREF(op);	/* extra INCREF so that this is never freed */
+		_Py_SetImmortal((PyObject *)op);	/* never freed */
 	}
 #endif
 	_PyObject_GC_TRACK(op);
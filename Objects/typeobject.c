@@ -18,6 +18,139 @@ static PyMemberDef type_members[] = {
 	{0}
 };
 
+/* Cache of _PyType_Lookup() results, keyed by the version tag of the
+   type and the attribute name. */
+#define MCACHE_MAX_ATTR_SIZE	100
+#define MCACHE_SIZE_EXP		10
+#define MCACHE_HASH(version, name_hash)					\
+		(((unsigned int)(version) * (unsigned int)(name_hash))	\
+			>> (8*sizeof(unsigned int) - MCACHE_SIZE_EXP))
+#define MCACHE_HASH_METHOD(type, name)					\
+		MCACHE_HASH((type)->tp_version_tag,			\
+			    ((PyStringObject *)(name))->ob_shash)
+#define MCACHE_CACHEABLE_NAME(name)					\
+		(PyString_CheckExact(name) &&				\
+		 PyString_GET_SIZE(name) <= MCACHE_MAX_ATTR_SIZE)
+
+struct method_cache_entry {
+	unsigned int version;
+	PyObject *name;		/* reference to exactly a str or None */
+	PyObject *value;	/* borrowed */
+};
+
+static struct method_cache_entry method_cache[1 << MCACHE_SIZE_EXP];
+static unsigned int next_version_tag = 0;
+
+/* Invalidate the version tag of type and all its subclasses.  This has
+   to be called whenever the attributes that _PyType_Lookup() finds on
+   type may change: after the base classes, mro, or attributes of the
+   type are altered.  Code that cached lookups under a version tag
+   (the JIT's inline caches) then sees a different or no tag. */
+void
+PyType_Modified(PyTypeObject *type)
+{
+	PyObject *raw, *ref;
+	Py_ssize_t i, n;
+
+	if (!PyType_HasFeature(type, Py_TPFLAGS_VALID_VERSION_TAG))
+		return;
+
+	raw = type->tp_subclasses;
+	if (raw != NULL) {
+		n = PyList_GET_SIZE(raw);
+		for (i = 0; i < n; i++) {
+			ref = PyList_GET_ITEM(raw, i);
+			ref = PyWeakref_GET_OBJECT(ref);
+			if (ref != Py_None) {
+				PyType_Modified((PyTypeObject *)ref);
+			}
+		}
+	}
+	type->tp_flags &= ~Py_TPFLAGS_VALID_VERSION_TAG;
+}
+
+/* Check that all base classes or elements of the mro of type can be
+   versioned: a type that inherits from a classic class, or whose
+   custom mro contains types that aren't its base classes, can't be
+   invalidated reliably and gives up its version tag for good.  Called
+   from mro_internal, which is also called on each subclass when their
+   mro is updated. */
+static void
+type_mro_modified(PyTypeObject *type, PyObject *bases)
+{
+	Py_ssize_t i, n;
+	int clear = 0;
+
+	if (!PyType_HasFeature(type, Py_TPFLAGS_HAVE_VERSION_TAG))
+		return;
+
+	n = PyTuple_GET_SIZE(bases);
+	for (i = 0; i < n; i++) {
+		PyObject *b = PyTuple_GET_ITEM(bases, i);
+		PyTypeObject *cls;
+
+		if (!PyType_Check(b)) {
+			clear = 1;
+			break;
+		}
+		cls = (PyTypeObject *)b;
+		if (!PyType_HasFeature(cls, Py_TPFLAGS_HAVE_VERSION_TAG) ||
+		    !PyType_IsSubtype(type, cls)) {
+			clear = 1;
+			break;
+		}
+	}
+
+	if (clear)
+		type->tp_flags &= ~(Py_TPFLAGS_HAVE_VERSION_TAG|
+				    Py_TPFLAGS_VALID_VERSION_TAG);
+}
+
+/* Make sure that tp_version_tag is valid and set
+   Py_TPFLAGS_VALID_VERSION_TAG.  To respect the invariant, this must
+   first be done on all base classes.  Returns 0 if the type can't be
+   versioned, 1 otherwise. */
+int
+_PyType_AssignVersionTag(PyTypeObject *type)
+{
+	Py_ssize_t i, n;
+	PyObject *bases;
+
+	if (PyType_HasFeature(type, Py_TPFLAGS_VALID_VERSION_TAG))
+		return 1;
+	if (!PyType_HasFeature(type, Py_TPFLAGS_HAVE_VERSION_TAG))
+		return 0;
+	if (!PyType_HasFeature(type, Py_TPFLAGS_READY))
+		return 0;
+
+	type->tp_version_tag = next_version_tag++;
+	if (type->tp_version_tag == 0) {
+		/* wrap-around or just starting Python: tag 0 is never
+		   valid.  Clear the whole method cache by filling names
+		   with references to Py_None; values are also set to NULL
+		   for added protection, as they are borrowed references.
+		   Then mark all version tags as invalid. */
+		for (i = 0; i < (1 << MCACHE_SIZE_EXP); i++) {
+			method_cache[i].value = NULL;
+			Py_XDECREF(method_cache[i].name);
+			method_cache[i].name = Py_None;
+			Py_INCREF(Py_None);
+		}
+		PyType_Modified(&PyBaseObject_Type);
+		return 0;
+	}
+	bases = type->tp_bases;
+	n = PyTuple_GET_SIZE(bases);
+	for (i = 0; i < n; i++) {
+		PyObject *b = PyTuple_GET_ITEM(bases, i);
+		assert(PyType_Check(b));
+		if (!_PyType_AssignVersionTag((PyTypeObject *)b))
+			return 0;
+	}
+	type->tp_flags |= Py_TPFLAGS_VALID_VERSION_TAG;
+	return 1;
+}
+
 static PyObject *
 type_name(PyTypeObject *type, void *context)
 {
@@ -117,6 +250,8 @@ type_set_module(PyTypeObject *type, PyObject *value, void *context)
 		return -1;
 	}
 
+	PyType_Modified(type);
+
 	return PyDict_SetItemString(type->tp_dict, "__module__", value);
 }
 
@@ -1350,6 +1485,14 @@ mro_internal(PyTypeObject *type)
 		}
 	}
 	type->tp_mro = tuple;
+
+	type_mro_modified(type, type->tp_mro);
+	/* corner case: the classic base class might have been hidden
+	   from the custom MRO */
+	type_mro_modified(type, type->tp_bases);
+
+	PyType_Modified(type);
+
 	return 0;
 }
 
@@ -2096,6 +2239,16 @@ _PyType_Lookup(PyTypeObject *type, PyObject *name)
 {
 	Py_ssize_t i, n;
 	PyObject *mro, *res, *base, *dict;
+	unsigned int h;
+
+	if (MCACHE_CACHEABLE_NAME(name) &&
+	    PyType_HasFeature(type, Py_TPFLAGS_VALID_VERSION_TAG)) {
+		/* fast path */
+		h = MCACHE_HASH_METHOD(type, name);
+		if (method_cache[h].version == type->tp_version_tag &&
+		    method_cache[h].name == name)
+			return method_cache[h].value;
+	}
 
 	/* Look in tp_dict of types in MRO */
 	mro = type->tp_mro;
@@ -2107,6 +2260,7 @@ _PyType_Lookup(PyTypeObject *type, PyObject *name)
 		return NULL;
 
 	assert(PyTuple_Check(mro));
+	res = NULL;
 	n = PyTuple_GET_SIZE(mro);
 	for (i = 0; i < n; i++) {
 		base = PyTuple_GET_ITEM(mro, i);
@@ -2119,9 +2273,18 @@ _PyType_Lookup(PyTypeObject *type, PyObject *name)
 		assert(dict && PyDict_Check(dict));
 		res = PyDict_GetItem(dict, name);
 		if (res != NULL)
-			return res;
+			break;
 	}
-	return NULL;
+
+	if (MCACHE_CACHEABLE_NAME(name) && _PyType_AssignVersionTag(type)) {
+		h = MCACHE_HASH_METHOD(type, name);
+		method_cache[h].version = type->tp_version_tag;
+		method_cache[h].value = res;  /* borrowed */
+		Py_INCREF(name);
+		Py_XDECREF(method_cache[h].name);
+		method_cache[h].name = name;
+	}
+	return res;
 }
 
 /* This is similar to PyObject_GenericGetAttr(),
@@ -2217,6 +2380,7 @@ type_setattro(PyTypeObject *type, PyObject *name, PyObject *value)
 	*/
 	if (PyObject_GenericSetAttr((PyObject *)type, name, value) < 0)
 		return -1;
+	PyType_Modified(type);
 	return update_slot(type, name);
 }
 
@@ -2338,6 +2502,9 @@ type_clear(PyTypeObject *type)
 	       A tuple of strings can't be part of a cycle.
 	*/
 
+	/* the collector is about to clear tp_dict */
+	PyType_Modified(type);
+
 	Py_CLEAR(type->tp_mro);
 
 	return 0;
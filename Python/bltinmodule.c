@@ -2289,6 +2289,20 @@ PyDoc_STRVAR(builtin_doc,
 \n\
 Noteworthy: None is the `nil' object; Ellipsis represents `...' in slices.");
 
+/* Find the method table entry of the builtin function name, whatever
+   the name is bound to in __builtin__ now; NULL if there is none. */
+PyMethodDef *
+_PyBuiltin_FindMethod(const char *name)
+{
+	PyMethodDef *ml;
+
+	for (ml = builtin_methods; ml->ml_name != NULL; ml++) {
+		if (strcmp(ml->ml_name, name) == 0)
+			return ml;
+	}
+	return NULL;
+}
+
 PyObject *
 _PyBuiltin_Init(void)
 {
@@ -575,9 +575,79 @@ PyEval_EvalFrameEx(PyFrameObject *f, int throwflag)
 	tstate->frame = f;
 	co = f->f_code;
 
-	jit_func = get_jitted_function(co);
+	if (tstate->use_tracing) {
+		if (tstate->c_tracefunc != NULL) {
+			/* tstate->c_tracefunc, if defined, is a
+			   function that will be called on *every* entry
+			   to a code block.  Its return value, if not
+			   None, is a function that will be called at
+			   the start of each executed line of code.
+			   (Actually, the function must return itself
+			   in order to continue tracing.)  The trace
+			   functions are called with three arguments:
+			   a pointer to the current frame, a string
+			   indicating why the function is called, and
+			   an argument which depends on the situation.
+			   The global trace function is also called
+			   whenever an exception is detected. */
+			if (call_trace_protected(tstate->c_tracefunc,
+						 tstate->c_traceobj,
+						 f, PyTrace_CALL, Py_None)) {
+				/* Trace function raised an error */
+				goto exit_eval_frame;
+			}
+		}
+		if (tstate->c_profilefunc != NULL) {
+			/* Similar for c_profilefunc, except it needn't
+			   return itself and isn't called for "line"
+			   events */
+			if (call_trace_protected(tstate->c_profilefunc,
+						 tstate->c_profileobj,
+						 f, PyTrace_CALL, Py_None)) {
+				/* Profile function raised an error */
+				goto exit_eval_frame;
+			}
+		}
+	}
+
+	/* Line and exception events need the traced interpreter;
+	   compiled code knows nothing about tracing. */
+	if (tstate->c_tracefunc != NULL)
+		jit_func = get_traced_function(co);
+	else
+		jit_func = get_jitted_function(co);
 	retval = jit_func(f, tstate, throwflag);
 
+	if (tstate->use_tracing) {
+		if (tstate->c_tracefunc) {
+			if (retval != NULL) {
+				if (call_trace(tstate->c_tracefunc,
+					       tstate->c_traceobj, f,
+					       PyTrace_RETURN, retval)) {
+					Py_DECREF(retval);
+					retval = NULL;
+				}
+			}
+			else {
+				call_trace_protected(tstate->c_tracefunc,
+						     tstate->c_traceobj, f,
+						     PyTrace_RETURN, NULL);
+			}
+		}
+		if (tstate->c_profilefunc) {
+			if (retval == NULL)
+				call_trace_protected(tstate->c_profilefunc,
+						     tstate->c_profileobj, f,
+						     PyTrace_RETURN, NULL);
+			else if (call_trace(tstate->c_profilefunc,
+					    tstate->c_profileobj, f,
+					    PyTrace_RETURN, retval)) {
+				Py_DECREF(retval);
+				retval = NULL;
+			}
+		}
+	}
+
 	if (tstate->frame->f_exc_type != NULL)
 		reset_exc_info(tstate);
 	else {
@@ -585,6 +655,7 @@ PyEval_EvalFrameEx(PyFrameObject *f, int throwflag)
 		assert(tstate->frame->f_exc_traceback == NULL);
 	}
 
+  exit_eval_frame:
 	Py_LeaveRecursiveCall();
 	tstate->frame = f->f_back;
 
@@ -1530,6 +1530,10 @@ opcode_stack_effect(int opcode, int oparg)
 		case CALL_FUNCTION_VAR_KW:
 			return -NARGS(oparg)-2;
 #undef NARGS
+		case LOAD_METHOD:
+			return 1;
+		case CALL_METHOD:
+			return -oparg-1;
 		case MAKE_FUNCTION:
 			return -oparg;
 		case BUILD_SLICE:
@@ -3172,6 +3176,20 @@ static int
 compiler_call(struct compiler *c, expr_ty e)
 {
 	int n, code = 0;
+	expr_ty func = e->v.Call.func;
+
+	/* obj.meth(args) looks meth up without binding it to obj and passes
+	   obj as the first argument (see LOAD_METHOD) */
+	n = asdl_seq_LEN(e->v.Call.args);
+	if (func->kind == Attribute_kind && func->v.Attribute.ctx == Load &&
+	    asdl_seq_LEN(e->v.Call.keywords) == 0 && !e->v.Call.starargs &&
+	    !e->v.Call.kwargs && n < 255) {
+		VISIT(c, expr, func->v.Attribute.value);
+		ADDOP_NAME(c, LOAD_METHOD, func->v.Attribute.attr, names);
+		VISIT_SEQ(c, expr, e->v.Call.args);
+		ADDOP_I(c, CALL_METHOD, n);
+		return 1;
+	}
 
 	VISIT(c, expr, e->v.Call.func);
 	n = asdl_seq_LEN(e->v.Call.args);
@@ -15,6 +15,7 @@
 #include "eval.h"
 #include "osdefs.h"
 #include "importdl.h"
+#include "../JitCompiler/JitCompiler.h"
 
 #ifdef HAVE_FCNTL_H
 #include <fcntl.h>
@@ -67,9 +68,10 @@ extern time_t PyOS_GetLastModificationTime(char *, FILE *);
        Python 2.5c1: 62121 (fix wrong lnotab with for loops and
        			    storing constants that should have been removed)
        Python 2.5c2: 62131 (fix wrong code: for x, in ... in listcomp/genexp)
+       Python 2.5+jit: 62141 (LOAD_METHOD and CALL_METHOD)
 .
 */
-#define MAGIC (62131 | ((long)'\r'<<16) | ((long)'\n'<<24))
+#define MAGIC (62141 | ((long)'\r'<<16) | ((long)'\n'<<24))
 
 /* Magic word as global; note that _PyImport_Init() can change the
    value of this global to accommodate for alterations of how the
@@ -777,6 +779,22 @@ read_compiled_module(char *cpathname, FILE *fp)
 }
 
 
+/* Give the code of a module the branch profiles saved for it by the
+   JIT compiler, in foo.pyj next to foo.pyc */
+
+static void
+load_profiles(PyCodeObject *co, char *cpathname)
+{
+	char buf[MAXPATHLEN+1];
+	size_t len = strlen(cpathname);
+
+	if (len == 0 || len > MAXPATHLEN)
+		return;
+	strcpy(buf, cpathname);
+	buf[len-1] = 'j';
+	load_jit_profiles(co, buf);
+}
+
 /* Load a module from a compiled file, execute it, and return its
    module object WITH INCREMENTED REFERENCE COUNT */
 
@@ -800,6 +818,7 @@ load_compiled_module(char *name, char *cpathname, FILE *fp)
 	if (Py_VerboseFlag)
 		PySys_WriteStderr("import %s # precompiled from %s\n",
 			name, cpathname);
+	load_profiles(co, cpathname);
 	m = PyImport_ExecCodeModuleEx(name, (PyObject *)co, cpathname);
 	Py_DECREF(co);
 
@@ -956,6 +975,8 @@ load_source_module(char *name, char *pathname, FILE *fp)
 		if (cpathname)
 			write_compiled_module(co, cpathname, mtime);
 	}
+	if (cpathname)
+		load_profiles(co, cpathname);
 	m = PyImport_ExecCodeModuleEx(name, (PyObject *)co, pathname);
 	Py_DECREF(co);
 
@@ -365,6 +365,7 @@ Py_Finalize(void)
 	 * the threads created via Threading.
 	 */
 	call_sys_exitfunc();
+	write_jit_profiles();
 	initialized = 0;
 
 	/* Get current thread state and interpreter pointer */
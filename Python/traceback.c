@@ -11,6 +11,57 @@
 
 #define OFF(x) offsetof(PyTracebackObject, x)
 
+/* A frame an exception passed through, and its f_lasti then.  Entries
+   own a reference to the frame. */
+struct _tbentry {
+	PyFrameObject *frame;
+	int lasti;
+};
+
+static PyTracebackObject *newtracebackobject(PyTracebackObject *,
+					     PyFrameObject *, int);
+
+/* Build the traceback objects of the frames in tb_pending, innermost
+   first, and link them between tb and tb_next. */
+static int
+tb_materialize(PyTracebackObject *tb)
+{
+	PyTracebackObject *next = tb->tb_next;
+	PyTracebackObject *newtb;
+	int i;
+
+	for (i = 0; i < tb->tb_npending; i++) {
+		newtb = newtracebackobject(next, tb->tb_pending[i].frame,
+					   tb->tb_pending[i].lasti);
+		if (newtb == NULL) {
+			/* keep what is left for another try */
+			tb->tb_npending -= i;
+			memmove(tb->tb_pending, tb->tb_pending + i,
+				tb->tb_npending * sizeof(struct _tbentry));
+			tb->tb_next = next;
+			return -1;
+		}
+		Py_XDECREF(next);
+		Py_DECREF(tb->tb_pending[i].frame);
+		next = newtb;
+	}
+	tb->tb_next = next;
+	tb->tb_npending = 0;
+	tb->tb_allocated = 0;
+	PyMem_Free(tb->tb_pending);
+	tb->tb_pending = NULL;
+	return 0;
+}
+
+static int
+tb_getlineno(PyTracebackObject *tb)
+{
+	if (tb->tb_lineno < 0)
+		tb->tb_lineno = PyCode_Addr2Line(tb->tb_frame->f_code,
+						 tb->tb_lasti);
+	return tb->tb_lineno;
+}
+
 static struct memberlist tb_memberlist[] = {
 	{"tb_next",	T_OBJECT,	OFF(tb_next)},
 	{"tb_frame",	T_OBJECT,	OFF(tb_frame)},
@@ -22,9 +73,28 @@ static struct memberlist tb_memberlist[] = {
 static PyObject *
 tb_getattr(PyTracebackObject *tb, char *name)
 {
+	if (strcmp(name, "tb_next") == 0 && tb->tb_npending > 0 &&
+	    tb_materialize(tb) < 0)
+		return NULL;
+	if (strcmp(name, "tb_lineno") == 0)
+		tb_getlineno(tb);
 	return PyMember_Get((char *)tb, tb_memberlist, name);
 }
 
+static void
+tb_clear_pending(PyTracebackObject *tb)
+{
+	struct _tbentry *pending = tb->tb_pending;
+	int i, n = tb->tb_npending;
+
+	tb->tb_pending = NULL;
+	tb->tb_npending = 0;
+	tb->tb_allocated = 0;
+	for (i = 0; i < n; i++)
+		Py_DECREF(pending[i].frame);
+	PyMem_Free(pending);
+}
+
 static void
 tb_dealloc(PyTracebackObject *tb)
 {
@@ -32,6 +102,7 @@ tb_dealloc(PyTracebackObject *tb)
 	Py_TRASHCAN_SAFE_BEGIN(tb)
 	Py_XDECREF(tb->tb_next);
 	Py_XDECREF(tb->tb_frame);
+	tb_clear_pending(tb);
 	PyObject_GC_Del(tb);
 	Py_TRASHCAN_SAFE_END(tb)
 }
@@ -39,8 +110,12 @@ tb_dealloc(PyTracebackObject *tb)
 static int
 tb_traverse(PyTracebackObject *tb, visitproc visit, void *arg)
 {
+	int i;
+
 	Py_VISIT(tb->tb_next);
 	Py_VISIT(tb->tb_frame);
+	for (i = 0; i < tb->tb_npending; i++)
+		Py_VISIT(tb->tb_pending[i].frame);
 	return 0;
 }
 
@@ -49,6 +124,7 @@ tb_clear(PyTracebackObject *tb)
 {
 	Py_CLEAR(tb->tb_next);
 	Py_CLEAR(tb->tb_frame);
+	tb_clear_pending(tb);
 }
 
 PyTypeObject PyTraceBack_Type = {
@@ -88,7 +164,7 @@ PyTypeObject PyTraceBack_Type = {
 };
 
 static PyTracebackObject *
-newtracebackobject(PyTracebackObject *next, PyFrameObject *frame)
+newtracebackobject(PyTracebackObject *next, PyFrameObject *frame, int lasti)
 {
 	PyTracebackObject *tb;
 	if ((next != NULL && !PyTraceBack_Check(next)) ||
@@ -102,20 +178,58 @@ newtracebackobject(PyTracebackObject *next, PyFrameObject *frame)
 		tb->tb_next = next;
 		Py_XINCREF(frame);
 		tb->tb_frame = frame;
-		tb->tb_lasti = frame->f_lasti;
-		tb->tb_lineno = PyCode_Addr2Line(frame->f_code, 
-						 frame->f_lasti);
+		tb->tb_lasti = lasti;
+		tb->tb_lineno = -1;
+		tb->tb_npending = 0;
+		tb->tb_allocated = 0;
+		tb->tb_pending = NULL;
 		PyObject_GC_Track(tb);
 	}
 	return tb;
 }
 
+/* Make tb, which nobody has seen yet, stand for frame: the frame it
+   stood for moves to tb_pending.  Saves allocating a traceback object
+   for every frame an exception unwinds. */
+static int
+tb_push(PyTracebackObject *tb, PyFrameObject *frame)
+{
+	if (tb->tb_npending == tb->tb_allocated) {
+		int n = tb->tb_allocated ? 2 * tb->tb_allocated : 8;
+		struct _tbentry *p = (struct _tbentry *)PyMem_Realloc(
+			tb->tb_pending, n * sizeof(struct _tbentry));
+		if (p == NULL)
+			return -1;
+		tb->tb_pending = p;
+		tb->tb_allocated = n;
+	}
+	tb->tb_pending[tb->tb_npending].frame = tb->tb_frame;
+	tb->tb_pending[tb->tb_npending].lasti = tb->tb_lasti;
+	tb->tb_npending++;
+	Py_INCREF(frame);
+	tb->tb_frame = frame;
+	tb->tb_lasti = frame->f_lasti;
+	tb->tb_lineno = -1;
+	return 0;
+}
+
 int
 PyTraceBack_Here(PyFrameObject *frame)
 {
 	PyThreadState *tstate = PyThreadState_GET();
 	PyTracebackObject *oldtb = (PyTracebackObject *) tstate->curexc_traceback;
-	PyTracebackObject *tb = newtracebackobject(oldtb, frame);
+	PyTracebackObject *tb;
+
+	/* Only the thread state holds the traceback so far: reuse it */
+	if (oldtb != NULL && oldtb->ob_refcnt == 1 &&
+	    PyTraceBack_Check(oldtb) && frame != NULL &&
+	    PyFrame_Check(frame) && tb_push(oldtb, frame) == 0)
+		return 0;
+	if (frame == NULL || !PyFrame_Check(frame)) {
+		PyErr_BadInternalCall();
+		return -1;
+	}
+	tb = newtracebackobject(oldtb, frame, frame->f_lasti);
 	if (tb == NULL)
 		return -1;
 	tstate->curexc_traceback = (PyObject *)tb;
@@ -226,7 +340,7 @@ tb_printinternal(PyTracebackObject *tb, PyObject *f, int limit)
 			err = tb_displayline(f,
 			    PyString_AsString(
 				    tb->tb_frame->f_code->co_filename),
-			    tb->tb_lineno,
+			    tb_getlineno(tb),
 			    PyString_AsString(tb->tb_frame->f_code->co_name));
 		}
 		depth--;
@@ -242,6 +356,7 @@ PyTraceBack_Print(PyObject *v, PyObject *f)
 {
 	int err;
 	PyObject *limitv;
+	PyTracebackObject *tb;
 	int limit = 1000;
 	if (v == NULL)
 		return 0;
@@ -249,6 +364,10 @@ PyTraceBack_Print(PyObject *v, PyObject *f)
 		PyErr_BadInternalCall();
 		return -1;
 	}
+	for (tb = (PyTracebackObject *)v; tb != NULL; tb = tb->tb_next) {
+		if (tb->tb_npending > 0 && tb_materialize(tb) < 0)
+			return -1;
+	}
 	limitv = PySys_GetObject("tracebacklimit");
 	if (limitv && PyInt_Check(limitv)) {
 		limit = PyInt_AsLong(limitv);